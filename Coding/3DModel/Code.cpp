@@ -1,6 +1,22 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <thread>
 #include <vector>
+#include <stack>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -23,7 +39,7 @@ float length(const Vec3& a)
 }
 
 
-void normalize(Vec3& a)
+float normalize(Vec3& a)
 {
 	float len = length(a);
 	if (len > 0.0f)
@@ -38,16 +54,321 @@ void normalize(Vec3& a)
 
 Vec3 cross(const Vec3& a, const Vec3& b)
 {
-    return Vec3() { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    return Vec3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
 }
 
 
 float angle(const Vec3& a, const Vec3& b)
 {
-    return std::acos(dot(a, b));
+    // rounding can push the dot product of unit vectors slightly outside [-1, 1]
+    return std::acos(std::max(-1.0f, std::min(1.0f, dot(a, b))));
 }
 
 
+// Computes n unit normals from the two edges e0, e1 of each triangle.
+// Inputs and outputs are in structure-of-arrays layout, degenerate triangles get a zero normal.
+void face_normals_soa(const float* e0x, const float* e0y, const float* e0z,
+                      const float* e1x, const float* e1y, const float* e1z,
+                      float* nx, float* ny, float* nz, const size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 ax = _mm256_loadu_ps(e0x + i), ay = _mm256_loadu_ps(e0y + i), az = _mm256_loadu_ps(e0z + i);
+        const __m256 bx = _mm256_loadu_ps(e1x + i), by = _mm256_loadu_ps(e1y + i), bz = _mm256_loadu_ps(e1z + i);
+        __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+        __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+        __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+        const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz)));
+        const __m256 valid = _mm256_cmp_ps(len, zero, _CMP_GT_OQ);
+        cx = _mm256_blendv_ps(cx, _mm256_div_ps(cx, len), valid);
+        cy = _mm256_blendv_ps(cy, _mm256_div_ps(cy, len), valid);
+        cz = _mm256_blendv_ps(cz, _mm256_div_ps(cz, len), valid);
+        _mm256_storeu_ps(nx + i, cx);
+        _mm256_storeu_ps(ny + i, cy);
+        _mm256_storeu_ps(nz + i, cz);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128 zero4 = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 ax = _mm_loadu_ps(e0x + i), ay = _mm_loadu_ps(e0y + i), az = _mm_loadu_ps(e0z + i);
+        const __m128 bx = _mm_loadu_ps(e1x + i), by = _mm_loadu_ps(e1y + i), bz = _mm_loadu_ps(e1z + i);
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+        const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+        // (a & valid) | (b & ~valid), SSE2 has no blend
+        const __m128 valid = _mm_cmpgt_ps(len, zero4);
+        cx = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(cx, len)), _mm_andnot_ps(valid, cx));
+        cy = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(cy, len)), _mm_andnot_ps(valid, cy));
+        cz = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(cz, len)), _mm_andnot_ps(valid, cz));
+        _mm_storeu_ps(nx + i, cx);
+        _mm_storeu_ps(ny + i, cy);
+        _mm_storeu_ps(nz + i, cz);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        Vec3 c = cross(Vec3{ e0x[i], e0y[i], e0z[i] }, Vec3{ e1x[i], e1y[i], e1z[i] });
+        normalize(c);
+        nx[i] = c[0];
+        ny[i] = c[1];
+        nz[i] = c[2];
+    }
+}
+
+
+// Splits [0, count) into contiguous ranges and runs job(begin, end) on each, one thread per range.
+// Small inputs use fewer threads, down to running inline.
+template <typename Job>
+void parallel_for(const size_t count, size_t threads, Job job)
+{
+    threads = std::max<size_t>(1, std::min(threads, count / 1024 + 1));
+    if (threads == 1)
+    {
+        job(size_t(0), count);
+        return;
+    }
+
+    vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back(job, count * t / threads, count * (t + 1) / threads);
+    }
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+}
+
+
+// Non-owning view over a contiguous list of indices
+struct IndexRange
+{
+    const size_t* first;
+    const size_t* last;
+
+    inline const size_t* begin() const { return first; }
+    inline const size_t* end()   const { return last; }
+    inline size_t size()         const { return last - first; }
+    inline bool empty()          const { return first == last; }
+    inline size_t operator[](const size_t i) const { return first[i]; }
+};
+
+
+// Binary mesh file layout, version 1.
+// A fixed header followed by the sections it points to, each starting on a 64 byte boundary.
+// Indices are stored as 64 bit integers so that faces can be viewed in place as Tri.
+struct MeshFileHeader
+{
+    char     magic[8];          // "MESHBIN"
+    uint32_t version;
+    uint32_t flags;             // MeshFileHeader::HasNormals | MeshFileHeader::HasAdjacency
+    uint64_t point_count;
+    uint64_t face_count;
+    uint64_t adjacency_count;   // number of entries in the adjacency neighbour list
+    uint64_t point_offset;      // byte offsets of the sections from the start of the file
+    uint64_t normal_offset;
+    uint64_t face_offset;
+    uint64_t adjacency_offset_offset;
+    uint64_t adjacency_face_offset;
+
+    static constexpr uint32_t Version      = 1;
+    static constexpr uint32_t HasNormals   = 0x1;
+    static constexpr uint32_t HasAdjacency = 0x2;
+    static constexpr uint64_t Alignment    = 64;
+};
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "mesh files store indices as 64 bit integers");
+static_assert(sizeof(Vec3) == 3 * sizeof(float) && sizeof(Tri) == 3 * sizeof(uint64_t), "Vec3 and Tri must be tightly packed");
+
+
+// Read-only, zero-copy view of a binary mesh file.
+// The file is mapped in memory and the accessors point straight into it, so opening costs no parsing
+// and pages are only read when touched.
+class MappedMesh
+{
+public:
+    MappedMesh() = default;
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+
+    ~MappedMesh()
+    {
+        close();
+    }
+
+    /// Maps the file at path, returns false if it cannot be opened or is not a valid mesh file.
+    /// Indices are checked on open, so a successfully opened file is safe to traverse.
+    bool open(const char* path)
+    {
+        close();
+
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MeshFileHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        m_data = static_cast<const char*>(data);
+        m_size = st.st_size;
+
+        if (!validate())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /// Unmaps the file, invalidating every pointer obtained from this mesh
+    void close()
+    {
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    inline bool is_open() const { return m_data != nullptr; }
+
+    inline const MeshFileHeader& header() const { return *reinterpret_cast<const MeshFileHeader*>(m_data); }
+
+    inline size_t point_count() const { return header().point_count; }
+
+    inline size_t face_count() const { return header().face_count; }
+
+    inline bool has_normals() const { return (header().flags & MeshFileHeader::HasNormals) != 0; }
+
+    inline bool has_adjacency() const { return (header().flags & MeshFileHeader::HasAdjacency) != 0; }
+
+    /// Returns the points list, point_count() entries
+    inline const Vec3* points() const { return section<Vec3>(header().point_offset); }
+
+    /// Returns the point normals list, point_count() entries, or nullptr if the file has none
+    inline const Vec3* normals() const { return has_normals() ? section<Vec3>(header().normal_offset) : nullptr; }
+
+    /// Returns the faces list, face_count() entries
+    inline const Tri* faces() const { return section<Tri>(header().face_offset); }
+
+    /// Returns the adjacency offsets, face_count() + 1 entries, or nullptr if the file has none
+    inline const size_t* adjacency_offsets() const { return has_adjacency() ? section<size_t>(header().adjacency_offset_offset) : nullptr; }
+
+    /// Returns the adjacency neighbour list, or nullptr if the file has none
+    inline const size_t* adjacency_faces() const { return has_adjacency() ? section<size_t>(header().adjacency_face_offset) : nullptr; }
+
+    /// Returns the faces adjacent to face i, only valid if has_adjacency()
+    inline IndexRange adjacent(const size_t i) const
+    {
+        const size_t* offset = adjacency_offsets();
+        const size_t* data = adjacency_faces();
+        return IndexRange{ data + offset[i], data + offset[i + 1] };
+    }
+
+private:
+    template <typename T>
+    inline const T* section(const uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(m_data + offset);
+    }
+
+    // checks the header, that every section lies inside the file, and that the indices stay in range:
+    // faces refer to existing points, and the adjacency offsets are a non decreasing list from 0 to
+    // adjacency_count of existing faces. This reads the faces and adjacency sections once.
+    bool validate() const
+    {
+        const MeshFileHeader& h = header();
+        if (std::memcmp(h.magic, "MESHBIN", 8) != 0 || h.version != MeshFileHeader::Version)
+        {
+            return false;
+        }
+
+        auto fits = [this](const uint64_t offset, const uint64_t count, const uint64_t stride)
+        {
+            return offset % MeshFileHeader::Alignment == 0 && offset <= m_size && count <= (m_size - offset) / stride;
+        };
+
+        bool ok = fits(h.point_offset, h.point_count, sizeof(Vec3)) && fits(h.face_offset, h.face_count, sizeof(Tri));
+        if (h.flags & MeshFileHeader::HasNormals)
+        {
+            ok = ok && fits(h.normal_offset, h.point_count, sizeof(Vec3));
+        }
+        if (h.flags & MeshFileHeader::HasAdjacency)
+        {
+            ok = ok && fits(h.adjacency_offset_offset, h.face_count + 1, sizeof(uint64_t))
+                    && fits(h.adjacency_face_offset, h.adjacency_count, sizeof(uint64_t));
+        }
+        if (!ok)
+        {
+            return false;
+        }
+
+        const Tri* face = faces();
+        for (size_t i = 0; i < h.face_count; ++i)
+        {
+            if (face[i][0] >= h.point_count || face[i][1] >= h.point_count || face[i][2] >= h.point_count)
+            {
+                return false;
+            }
+        }
+
+        if (h.flags & MeshFileHeader::HasAdjacency)
+        {
+            const size_t* offset = adjacency_offsets();
+            if (offset[0] != 0 || offset[h.face_count] != h.adjacency_count)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < h.face_count; ++i)
+            {
+                if (offset[i] > offset[i + 1])
+                {
+                    return false;
+                }
+            }
+            const size_t* adjacent = adjacency_faces();
+            for (size_t i = 0; i < h.adjacency_count; ++i)
+            {
+                if (adjacent[i] >= h.face_count)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+};
+
+
+// Weighting of the face normals when averaging them at a point
+enum class NormalWeight
+{
+    Uniform,    // every incident face counts the same
+    Area,       // faces weighted by their area
+    Angle       // faces weighted by their corner angle at the point
+};
+
+
 class Model
 {
 public:
@@ -71,35 +392,447 @@ public:
         return m_face[i];
     }
 
+    /// Return the unit normal of the i-th triangle in the model.
+    /// Normals are cached, and only the faces touched by set_point() are recomputed.
+    /// Not thread safe while the cache is dirty: call update_face_normals() first.
 	inline Vec3 face_normal(const size_t i) const
 	{
-		Vec3 p0 = point(m_face[i][0]);
-		Vec3 p1 = point(m_face[i][1]);
-		Vec3 p2 = point(m_face[i][2]);
-        Vec3 e0 = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
-        Vec3 e1 = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
-        Vec3 n = cross(e0, e1);
-        normalize(n);
-		return n;
+        update_face_normals();
+		return Vec3{ m_fn_x[i], m_fn_y[i], m_fn_z[i] };
 	}
 
-    /// Returns the faces adjacent to face i
-    vector<size_t> adjacent(const size_t i) const
+    /// Moves the i-th point, marking the faces around it for normal recomputation
+    void set_point(const size_t i, const Vec3& p)
+    {
+        m_point[i] = p;
+        if (!m_normals_dirty)
+        {
+            m_dirty_point.push_back(i);
+        }
+    }
+
+    /// Replaces the points of the model, invalidating all the face normals
+    void set_points(vector<Vec3> points)
+    {
+        m_point = std::move(points);
+        m_incidence_dirty = true;
+        m_normals_dirty = true;
+        m_dirty_point.clear();
+    }
+
+    /// Returns the faces using the i-th point.
+    /// Same lifetime and threading rules as adjacent().
+    IndexRange incident_faces(const size_t i) const
+    {
+        if (m_incidence_dirty)
+        {
+            build_incidence();
+        }
+        const size_t* data = m_vf_face.data();
+        return IndexRange{ data + m_vf_offset[i], data + m_vf_offset[i + 1] };
+    }
+
+    /// Builds the point to face incidence index in compressed sparse row form
+    void build_incidence() const
     {
-        return vector<size_t>();
+        const size_t F = m_face.size();
+        m_vf_offset.assign(m_point.size() + 1, 0);
+        for (const Tri& t : m_face)
+        {
+            ++m_vf_offset[t[0] + 1];
+            ++m_vf_offset[t[1] + 1];
+            ++m_vf_offset[t[2] + 1];
+        }
+        for (size_t v = 0; v < m_point.size(); ++v)
+        {
+            m_vf_offset[v + 1] += m_vf_offset[v];
+        }
+
+        // faces are visited in order, so each point's list is sorted by face index
+        m_vf_face.resize(m_vf_offset.back());
+        vector<size_t> cursor(m_vf_offset.begin(), m_vf_offset.end() - 1);
+        for (size_t f = 0; f < F; ++f)
+        {
+            for (const size_t v : m_face[f])
+            {
+                m_vf_face[cursor[v]++] = f;
+            }
+        }
+
+        m_incidence_dirty = false;
+    }
+
+    /// Brings the face normal cache up to date, either in full or only for the faces around moved points
+    void update_face_normals() const
+    {
+        if (m_normals_dirty)
+        {
+            const size_t F = m_face.size();
+            m_fn_x.resize(F);
+            m_fn_y.resize(F);
+            m_fn_z.resize(F);
+            compute_face_normals(F, [](const size_t f) { return f; });
+            m_normals_dirty = false;
+            m_dirty_point.clear();
+            return;
+        }
+
+        if (m_dirty_point.empty())
+        {
+            return;
+        }
+
+        // collect each touched face once
+        vector<size_t> faces;
+        vector<bool> touched(m_face.size(), false);
+        for (const size_t v : m_dirty_point)
+        {
+            for (const size_t f : incident_faces(v))
+            {
+                if (!touched[f])
+                {
+                    touched[f] = true;
+                    faces.push_back(f);
+                }
+            }
+        }
+        compute_face_normals(faces.size(), [&faces](const size_t k) { return faces[k]; });
+        m_dirty_point.clear();
+    }
+
+    /// Returns the number of triangles in the model
+    inline size_t face_count() const
+    {
+        return m_face.size();
+    }
+
+    /// Replaces the triangles of the model, invalidating the adjacency index and face normals
+    void set_faces(vector<Tri> faces)
+    {
+        m_face = std::move(faces);
+        m_adjacency_dirty = true;
+        m_incidence_dirty = true;
+        m_normals_dirty = true;
+        m_dirty_point.clear();
+    }
+
+    /// Returns the faces adjacent to face i.
+    /// The range points into the adjacency index, which is built on first use
+    /// and stays valid until the faces are changed. Not thread safe on first call:
+    /// call build_adjacency() before sharing the model between threads.
+    IndexRange adjacent(const size_t i) const
+    {
+        if (m_adjacency_dirty)
+        {
+            build_adjacency();
+        }
+        const size_t* data = m_adj_face.data();
+        return IndexRange{ data + m_adj_offset[i], data + m_adj_offset[i + 1] };
+    }
+
+    /// Builds the face adjacency index in compressed sparse row form.
+    /// Two faces are adjacent if they share an edge.
+    void build_adjacency() const
+    {
+        // an edge, stored with sorted endpoints, and the face it belongs to
+        struct EdgeRef
+        {
+            size_t v0;
+            size_t v1;
+            size_t face;
+
+            bool operator<(const EdgeRef& other) const
+            {
+                return v0 < other.v0 || (v0 == other.v0 && v1 < other.v1);
+            }
+
+            bool same_edge(const EdgeRef& other) const
+            {
+                return v0 == other.v0 && v1 == other.v1;
+            }
+        };
+
+        const size_t F = m_face.size();
+
+        // list every edge of every face, then sort so that shared edges are contiguous
+        vector<EdgeRef> edges;
+        edges.reserve(3 * F);
+        for (size_t f = 0; f < F; ++f)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const size_t a = m_face[f][k];
+                const size_t b = m_face[f][(k + 1) % 3];
+                edges.push_back(EdgeRef{ std::min(a, b), std::max(a, b), f });
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        // first pass counts the neighbours of each face, second pass fills them in
+        m_adj_offset.assign(F + 1, 0);
+        m_adj_face.clear();
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            vector<size_t> cursor;
+            if (pass == 1)
+            {
+                for (size_t f = 0; f < F; ++f)
+                {
+                    m_adj_offset[f + 1] += m_adj_offset[f];
+                }
+                m_adj_face.resize(m_adj_offset[F]);
+                cursor.assign(m_adj_offset.begin(), m_adj_offset.end() - 1);
+            }
+
+            for (size_t begin = 0; begin < edges.size();)
+            {
+                size_t end = begin + 1;
+                while (end < edges.size() && edges[begin].same_edge(edges[end]))
+                {
+                    ++end;
+                }
+
+                // every face on this edge is adjacent to every other face on it
+                for (size_t i = begin; i < end; ++i)
+                {
+                    for (size_t j = begin; j < end; ++j)
+                    {
+                        if (i == j)
+                        {
+                            continue;
+                        }
+                        if (pass == 0)
+                        {
+                            ++m_adj_offset[edges[i].face + 1];
+                        }
+                        else
+                        {
+                            m_adj_face[cursor[edges[i].face]++] = edges[j].face;
+                        }
+                    }
+                }
+                begin = end;
+            }
+        }
+
+        m_adjacency_dirty = false;
+    }
+
+    /// Regenerates the point normals by averaging the normals of the incident faces.
+    /// Each thread owns a range of points and gathers from the point to face index,
+    /// so no two threads ever write the same normal.
+    void recompute_vertex_normals(const NormalWeight weight = NormalWeight::Area,
+                                  const size_t threads = std::thread::hardware_concurrency())
+    {
+        // the lazy caches are not thread safe, fill them before spawning
+        if (m_incidence_dirty)
+        {
+            build_incidence();
+        }
+        update_face_normals();
+
+        const size_t F = m_face.size();
+        const size_t V = m_point.size();
+
+        // weight of each face corner, Uniform needs none
+        vector<float> corner_weight;
+        if (weight != NormalWeight::Uniform)
+        {
+            corner_weight.resize(3 * F);
+            parallel_for(F, threads, [&](const size_t begin, const size_t end)
+            {
+                for (size_t f = begin; f < end; ++f)
+                {
+                    const Tri& t = m_face[f];
+                    for (size_t k = 0; k < 3; ++k)
+                    {
+                        const Vec3& p0 = m_point[t[k]];
+                        const Vec3& p1 = m_point[t[(k + 1) % 3]];
+                        const Vec3& p2 = m_point[t[(k + 2) % 3]];
+                        Vec3 e0 = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                        Vec3 e1 = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                        if (weight == NormalWeight::Area)
+                        {
+                            corner_weight[3 * f + k] = 0.5f * length(cross(e0, e1));
+                        }
+                        else
+                        {
+                            const bool valid = normalize(e0) > 0.0f && normalize(e1) > 0.0f;
+                            corner_weight[3 * f + k] = valid ? std::acos(std::max(-1.0f, std::min(1.0f, dot(e0, e1)))) : 0.0f;
+                        }
+                    }
+                }
+            });
+        }
+
+        m_normal.resize(V);
+        parallel_for(V, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t v = begin; v < end; ++v)
+            {
+                Vec3 n = { 0.0f, 0.0f, 0.0f };
+                for (const size_t f : incident_faces(v))
+                {
+                    float w = 1.0f;
+                    if (!corner_weight.empty())
+                    {
+                        const Tri& t = m_face[f];
+                        const size_t k = t[0] == v ? 0 : (t[1] == v ? 1 : 2);
+                        w = corner_weight[3 * f + k];
+                    }
+                    n[0] += w * m_fn_x[f];
+                    n[1] += w * m_fn_y[f];
+                    n[2] += w * m_fn_z[f];
+                }
+                normalize(n);
+                m_normal[v] = n;
+            }
+        });
+    }
+
+    /// Copies points, normals and faces from a mapped mesh file.
+    /// The stored adjacency, if any, is adopted instead of being rebuilt.
+    void load(const MappedMesh& mesh)
+    {
+        m_point.assign(mesh.points(), mesh.points() + mesh.point_count());
+        if (mesh.has_normals())
+        {
+            m_normal.assign(mesh.normals(), mesh.normals() + mesh.point_count());
+        }
+        else
+        {
+            m_normal.clear();
+        }
+        set_faces(vector<Tri>(mesh.faces(), mesh.faces() + mesh.face_count()));
+
+        if (mesh.has_adjacency())
+        {
+            const size_t* offset = mesh.adjacency_offsets();
+            m_adj_offset.assign(offset, offset + mesh.face_count() + 1);
+            m_adj_face.assign(mesh.adjacency_faces(), mesh.adjacency_faces() + offset[mesh.face_count()]);
+            m_adjacency_dirty = false;
+        }
+    }
+
+    /// Writes the model as a binary mesh file, readable with MappedMesh.
+    /// Normals are stored only if present for every point, adjacency only if requested.
+    bool save(const char* path, const bool with_adjacency = true) const
+    {
+        if (with_adjacency && m_adjacency_dirty)
+        {
+            build_adjacency();
+        }
+
+        FILE* file = std::fopen(path, "wb");
+        if (!file)
+        {
+            return false;
+        }
+
+        const bool with_normals = !m_point.empty() && m_normal.size() == m_point.size();
+
+        MeshFileHeader h = {};
+        std::memcpy(h.magic, "MESHBIN", 8);
+        h.version = MeshFileHeader::Version;
+        h.flags = (with_normals ? MeshFileHeader::HasNormals : 0) | (with_adjacency ? MeshFileHeader::HasAdjacency : 0);
+        h.point_count = m_point.size();
+        h.face_count = m_face.size();
+        h.adjacency_count = with_adjacency ? m_adj_face.size() : 0;
+
+        // lay out the sections one after the other, each aligned
+        uint64_t end = sizeof(MeshFileHeader);
+        auto place = [&end](const uint64_t bytes)
+        {
+            const uint64_t offset = (end + MeshFileHeader::Alignment - 1) / MeshFileHeader::Alignment * MeshFileHeader::Alignment;
+            end = offset + bytes;
+            return offset;
+        };
+        h.point_offset = place(m_point.size() * sizeof(Vec3));
+        h.normal_offset = with_normals ? place(m_normal.size() * sizeof(Vec3)) : 0;
+        h.face_offset = place(m_face.size() * sizeof(Tri));
+        h.adjacency_offset_offset = with_adjacency ? place(m_adj_offset.size() * sizeof(size_t)) : 0;
+        h.adjacency_face_offset = with_adjacency ? place(m_adj_face.size() * sizeof(size_t)) : 0;
+
+        uint64_t written = 0;
+        auto write = [&](const uint64_t offset, const void* data, const size_t bytes)
+        {
+            static const char padding[MeshFileHeader::Alignment] = {};
+            bool ok = std::fwrite(padding, 1, offset - written, file) == offset - written
+                   && std::fwrite(data, 1, bytes, file) == bytes;
+            written = offset + bytes;
+            return ok;
+        };
+
+        bool ok = write(0, &h, sizeof(h))
+               && write(h.point_offset, m_point.data(), m_point.size() * sizeof(Vec3))
+               && (!with_normals || write(h.normal_offset, m_normal.data(), m_normal.size() * sizeof(Vec3)))
+               && write(h.face_offset, m_face.data(), m_face.size() * sizeof(Tri))
+               && (!with_adjacency || write(h.adjacency_offset_offset, m_adj_offset.data(), m_adj_offset.size() * sizeof(size_t)))
+               && (!with_adjacency || write(h.adjacency_face_offset, m_adj_face.data(), m_adj_face.size() * sizeof(size_t)));
+
+        return std::fclose(file) == 0 && ok;
     }
 
 protected:
+    /// Recomputes the normals of count faces, where face_of(k) gives the k-th face index.
+    /// Faces are gathered in blocks into structure-of-arrays buffers for face_normals_soa.
+    template <typename FaceOf>
+    void compute_face_normals(const size_t count, FaceOf face_of) const
+    {
+        constexpr size_t block = 256;
+        float e0x[block], e0y[block], e0z[block];
+        float e1x[block], e1y[block], e1z[block];
+        float nx[block], ny[block], nz[block];
+
+        for (size_t start = 0; start < count; start += block)
+        {
+            const size_t n = std::min(block, count - start);
+            for (size_t k = 0; k < n; ++k)
+            {
+                const Tri& t = m_face[face_of(start + k)];
+                const Vec3& p0 = m_point[t[0]];
+                const Vec3& p1 = m_point[t[1]];
+                const Vec3& p2 = m_point[t[2]];
+                e0x[k] = p1[0] - p0[0]; e0y[k] = p1[1] - p0[1]; e0z[k] = p1[2] - p0[2];
+                e1x[k] = p2[0] - p0[0]; e1y[k] = p2[1] - p0[1]; e1z[k] = p2[2] - p0[2];
+            }
+
+            face_normals_soa(e0x, e0y, e0z, e1x, e1y, e1z, nx, ny, nz, n);
+
+            for (size_t k = 0; k < n; ++k)
+            {
+                const size_t f = face_of(start + k);
+                m_fn_x[f] = nx[k];
+                m_fn_y[f] = ny[k];
+                m_fn_z[f] = nz[k];
+            }
+        }
+    }
+
     vector<Vec3> m_point;   // points list
     vector<Vec3> m_normal;  // point normals list
     vector<Tri>  m_face;    // faces list
+
+    mutable vector<size_t> m_adj_offset;        // adjacency of face i is m_adj_face[m_adj_offset[i], m_adj_offset[i+1])
+    mutable vector<size_t> m_adj_face;          // adjacent faces, grouped by face
+    mutable bool           m_adjacency_dirty = true;
+
+    mutable vector<size_t> m_vf_offset;         // faces using point i are m_vf_face[m_vf_offset[i], m_vf_offset[i+1])
+    mutable vector<size_t> m_vf_face;           // incident faces, grouped by point
+    mutable bool           m_incidence_dirty = true;
+
+    mutable vector<float>  m_fn_x;              // face normals, structure of arrays
+    mutable vector<float>  m_fn_y;
+    mutable vector<float>  m_fn_z;
+    mutable vector<size_t> m_dirty_point;       // points moved since the last normal update
+    mutable bool           m_normals_dirty = true;
 };
 
 
 vector<size_t> flat_region(const Model& M, const size_t f0, const float threshold)
 {
     std::vector<size_t> result = { f0 };
-	std::map<size_t, bool> visited;
+	std::vector<bool> visited(M.face_count(), false);
 	std::stack<size_t> stack;
 	
     const Vec3 n0 = M.face_normal(f0);
@@ -129,9 +862,131 @@ vector<size_t> flat_region(const Model& M, const size_t f0, const float threshol
 
 		for (const auto& fj : M.adjacent(fi))
 		{
-			stack.push(fj);
+			if (!visited[fj])
+			{
+				stack.push(fj);
+			}
 		}
     }
 
     return result;
 }
+
+
+// Result of a whole mesh segmentation
+struct FlatRegions
+{
+    vector<size_t>         label;   // region id of each face
+    vector<vector<size_t>> region;  // faces of each region, in ascending order
+};
+
+
+// Lock-free union-find helpers over atomic parent links.
+// Roots are always the smallest index of their set, so unions never form cycles.
+size_t uf_find(vector<atomic<size_t>>& parent, size_t x)
+{
+    while (true)
+    {
+        size_t p = parent[x].load(std::memory_order_relaxed);
+        if (p == x)
+        {
+            return x;
+        }
+        // path halving, losing the race here is harmless
+        size_t gp = parent[p].load(std::memory_order_relaxed);
+        parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        x = gp;
+    }
+}
+
+
+void uf_unite(vector<atomic<size_t>>& parent, size_t a, size_t b)
+{
+    while (true)
+    {
+        a = uf_find(parent, a);
+        b = uf_find(parent, b);
+        if (a == b)
+        {
+            return;
+        }
+        if (a < b)
+        {
+            std::swap(a, b);
+        }
+        // hook the larger root under the smaller one, retry if a was re-parented meanwhile
+        size_t expected = a;
+        if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+
+/// Labels every face of the model with a flat region id.
+/// Two adjacent faces belong to the same region when the angle between their normals is below threshold,
+/// and regions are the connected components of that relation. Region ids follow the order of their smallest face.
+/// Note that flat_region instead walks from a seed and keeps the faces whose normal is close to the seed normal,
+/// so on curved surfaces the two can differ in both directions.
+FlatRegions segment_flat_regions(const Model& M, const float threshold, size_t threads = std::thread::hardware_concurrency())
+{
+    const size_t F = M.face_count();
+
+    // the lazy caches are not thread safe, fill them before spawning
+    M.build_adjacency();
+    M.update_face_normals();
+
+    vector<atomic<size_t>> parent(F);
+    for (size_t f = 0; f < F; ++f)
+    {
+        parent[f].store(f, std::memory_order_relaxed);
+    }
+
+    // angle(a, b) < threshold, as a test on the dot product
+    const float cos_threshold = (threshold <= 0.0f) ? 2.0f : (threshold > std::acos(-1.0f)) ? -2.0f : std::cos(threshold);
+
+    // each adjacent pair is tested once, by its smaller face
+    parallel_for(F, threads, [&](const size_t begin, const size_t end)
+    {
+        for (size_t fi = begin; fi < end; ++fi)
+        {
+            const Vec3 ni = M.face_normal(fi);
+            for (const size_t fj : M.adjacent(fi))
+            {
+                if (fj > fi && std::min(1.0f, dot(ni, M.face_normal(fj))) > cos_threshold)
+                {
+                    uf_unite(parent, fi, fj);
+                }
+            }
+        }
+    });
+
+    FlatRegions result;
+    result.label.resize(F);
+    parallel_for(F, threads, [&](const size_t begin, const size_t end)
+    {
+        for (size_t f = begin; f < end; ++f)
+        {
+            result.label[f] = uf_find(parent, f);
+        }
+    });
+
+    // a root is the smallest face of its region, so it is met before any other face of it
+    for (size_t f = 0; f < F; ++f)
+    {
+        const size_t root = result.label[f];
+        if (root == f)
+        {
+            result.label[f] = result.region.size();
+            result.region.emplace_back();
+        }
+        else
+        {
+            result.label[f] = result.label[root];
+        }
+        result.region[result.label[f]].push_back(f);
+    }
+
+    return result;
+}
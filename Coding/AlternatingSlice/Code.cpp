@@ -1,6 +1,12 @@
 #include <algorithm>
+#include <cstdint>
+#include <thread>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 
 int solution(std::vector<int>& A)
 {
@@ -58,3 +64,193 @@ int solution(std::vector<int>& A)
     return lenght;
 }
 
+
+// A slice is alternating if every element matches one of the two sign patterns:
+//   - even pattern: elements at even (absolute) index are >= 0, elements at odd index are <= 0
+//   - odd pattern:  elements at even (absolute) index are <= 0, elements at odd index are >= 0
+// Starting a slice at an odd index just swaps the two, so the longest alternating slice is
+// the longest run of consecutive elements matching the same pattern. Runs compose associatively,
+// which lets the array be split in chunks, summarized independently (or as they arrive) and merged.
+
+
+// Summary of a sequence of booleans, in terms of runs of true values
+struct RunSummary
+{
+    std::size_t length = 0; // number of values summarized
+    std::size_t prefix = 0; // run at the beginning
+    std::size_t suffix = 0; // run at the end
+    std::size_t best   = 0; // longest run
+};
+
+
+// Summary of the sequence a followed by the sequence b
+RunSummary combine(const RunSummary& a, const RunSummary& b)
+{
+    RunSummary r;
+    r.length = a.length + b.length;
+    r.prefix = a.prefix == a.length ? a.length + b.prefix : a.prefix;
+    r.suffix = b.suffix == b.length ? b.length + a.suffix : b.suffix;
+    r.best   = std::max({ a.best, b.best, a.suffix + b.prefix });
+    return r;
+}
+
+
+// Summary of the first width bits of mask, bit 0 first
+RunSummary summarize_bits(std::uint64_t mask, const std::size_t width)
+{
+    RunSummary r;
+    r.length = width;
+    if (width < 64)
+    {
+        mask &= (std::uint64_t(1) << width) - 1;
+    }
+    if (width == 64 ? ~mask == 0 : mask == (std::uint64_t(1) << width) - 1)
+    {
+        r.prefix = r.suffix = r.best = width;
+        return r;
+    }
+
+    r.prefix = __builtin_ctzll(~mask);
+    r.suffix = __builtin_clzll(~(mask << (64 - width)));
+
+    // walk the runs, skipping zeros then counting ones
+    while (mask)
+    {
+        mask >>= __builtin_ctzll(mask);
+        const std::size_t run = ~mask ? __builtin_ctzll(~mask) : 64;
+        r.best = std::max(r.best, run);
+        mask = run < 64 ? mask >> run : 0;
+    }
+    return r;
+}
+
+
+// Summary of both patterns over a range of the array
+struct AlternatingSummary
+{
+    RunSummary even;
+    RunSummary odd;
+
+    // longest alternating slice in the summarized range
+    std::size_t longest() const
+    {
+        return std::max(even.best, odd.best);
+    }
+};
+
+
+AlternatingSummary combine(const AlternatingSummary& a, const AlternatingSummary& b)
+{
+    return AlternatingSummary{ combine(a.even, b.even), combine(a.odd, b.odd) };
+}
+
+
+// Summarizes A[0, n), where A[0] is at absolute index base.
+// Elements are processed 64 at a time: the sign bits are packed in masks, and the pattern
+// matches of a whole block are computed with a few bitwise operations.
+AlternatingSummary summarize(const int* A, const std::size_t n, const std::size_t base)
+{
+    AlternatingSummary r;
+    for (std::size_t start = 0; start < n; start += 64)
+    {
+        const std::size_t width = std::min<std::size_t>(64, n - start);
+        const int* block = A + start;
+
+        // bit k set if block[k] < 0 (neg) or block[k] > 0 (pos)
+        std::uint64_t neg = 0;
+        std::uint64_t pos = 0;
+        std::size_t k = 0;
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        for (; k + 8 <= width; k += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + k));
+            neg |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(v))) << k;
+            pos |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, zero)))) << k;
+        }
+#endif
+        for (; k < width; ++k)
+        {
+            neg |= std::uint64_t(block[k] < 0) << k;
+            pos |= std::uint64_t(block[k] > 0) << k;
+        }
+
+        // bits at even absolute index
+        const std::uint64_t even_index = ((base + start) % 2 == 0) ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull;
+        const std::uint64_t odd_index = ~even_index;
+
+        const std::uint64_t even_match = (~neg & even_index) | (~pos & odd_index);
+        const std::uint64_t odd_match  = (~pos & even_index) | (~neg & odd_index);
+
+        r.even = combine(r.even, summarize_bits(even_match, width));
+        r.odd  = combine(r.odd, summarize_bits(odd_match, width));
+    }
+    return r;
+}
+
+
+// Same problem, without overflowing products, splitting the array across threads.
+// Follows the definition in the description: the triple check in solution() also accepts
+// slices like {1, 0, 0, 1}, whose two ends break the sign pattern.
+int solution(const std::vector<int>& A, std::size_t threads)
+{
+    const std::size_t N = A.size();
+    threads = std::max<std::size_t>(1, std::min(threads, N / 65536 + 1));
+
+    std::vector<AlternatingSummary> partial(threads);
+    auto work = [&A, &partial, N, threads](std::size_t t)
+    {
+        const std::size_t begin = N * t / threads;
+        const std::size_t end = N * (t + 1) / threads;
+        partial[t] = summarize(A.data() + begin, end - begin, begin);
+    };
+
+    // the first chunk runs on the calling thread, so a single chunk starts no thread at all
+    std::vector<std::thread> pool;
+    for (std::size_t t = 1; t < threads; ++t)
+    {
+        pool.emplace_back(work, t);
+    }
+    work(0);
+
+    AlternatingSummary total = partial[0];
+    for (std::size_t t = 1; t < threads; ++t)
+    {
+        pool[t - 1].join();
+        total = combine(total, partial[t]);
+    }
+    return static_cast<int>(total.longest());
+}
+
+
+// Longest alternating slice of a sequence received in chunks.
+// Only the running summary is kept, so the answer is updated in time proportional to the new chunk.
+class AlternatingStream
+{
+public:
+    /// Appends n values to the sequence
+    void append(const int* data, const std::size_t n)
+    {
+        m_summary = combine(m_summary, summarize(data, n, m_summary.even.length));
+    }
+
+    void append(const std::vector<int>& data)
+    {
+        append(data.data(), data.size());
+    }
+
+    /// Returns the size of the largest alternating slice received so far
+    std::size_t longest() const
+    {
+        return m_summary.longest();
+    }
+
+    /// Returns the number of values received so far
+    std::size_t size() const
+    {
+        return m_summary.even.length;
+    }
+
+private:
+    AlternatingSummary m_summary;
+};
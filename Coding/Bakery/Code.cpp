@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 int CountHappyGroups(int BatchSize, const std::vector<int>& Groups)
@@ -11,3 +17,374 @@ int CountHappyGroups(int BatchSize, const std::vector<int>& Groups)
 	}
 	return count;
 }
+
+
+// Remainder by a fixed divisor without a division, using a precomputed reciprocal (Lemire et al.)
+struct FastMod
+{
+	std::uint64_t M;
+	std::uint32_t d;
+
+	explicit FastMod(std::uint32_t divisor) : M(UINT64_C(0xFFFFFFFFFFFFFFFF) / divisor + 1), d(divisor) {}
+
+	inline std::uint32_t operator()(std::uint32_t a) const
+	{
+		const std::uint64_t low = M * a;
+		return static_cast<std::uint32_t>((static_cast<unsigned __int128>(low) * d) >> 64);
+	}
+};
+
+
+// A group is happy when the breads served before it are a multiple of BatchSize,
+// i.e. when the prefix sum of the previous groups is 0 modulo BatchSize.
+// Prefix sums compose by addition, so the line can be split in chunks:
+//   1. each chunk computes its total (in parallel)
+//   2. the totals are scanned to get the breads served before each chunk
+//   3. each chunk counts its happy groups starting from that offset (in parallel)
+// Every BatchSize is evaluated in the same pass over Groups. Group sizes must be non negative.
+std::vector<int> CountHappyGroups(const std::vector<int>& BatchSizes, const std::vector<int>& Groups, std::size_t threads)
+{
+	const std::size_t N = Groups.size();
+	const std::size_t Q = BatchSizes.size();
+	threads = std::max<std::size_t>(1, std::min(threads, N * std::max<std::size_t>(Q, 1) / 65536 + 1));
+
+	// chunk 0 runs on the calling thread, so a single chunk starts no thread at all
+	auto run = [threads](auto job)
+	{
+		std::vector<std::thread> pool;
+		for (std::size_t t = 1; t < threads; ++t)
+		{
+			pool.emplace_back(job, t);
+		}
+		job(std::size_t(0));
+		for (auto& th : pool)
+		{
+			th.join();
+		}
+	};
+	auto chunk = [N, threads](std::size_t t) { return N * t / threads; };
+
+	// 1. chunk totals
+	std::vector<std::uint64_t> offset(threads + 1, 0);
+	run([&](std::size_t t)
+	{
+		std::uint64_t sum = 0;
+		for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+		{
+			sum += static_cast<std::uint32_t>(Groups[i]);
+		}
+		offset[t + 1] = sum;
+	});
+
+	// 2. exclusive scan of the totals
+	for (std::size_t t = 0; t < threads; ++t)
+	{
+		offset[t + 1] += offset[t];
+	}
+
+	std::vector<FastMod> mod;
+	for (int b : BatchSizes)
+	{
+		mod.emplace_back(static_cast<std::uint32_t>(b));
+	}
+
+	// 3. per chunk counts, with one residue per batch size
+	std::vector<std::vector<int>> partial(threads, std::vector<int>(Q, 0));
+	run([&](std::size_t t)
+	{
+		std::vector<std::uint32_t> r(Q);
+		for (std::size_t q = 0; q < Q; ++q)
+		{
+			r[q] = static_cast<std::uint32_t>(offset[t] % mod[q].d);
+		}
+
+		std::vector<int>& count = partial[t];
+		for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+		{
+			const std::uint32_t n = static_cast<std::uint32_t>(Groups[i]);
+			for (std::size_t q = 0; q < Q; ++q)
+			{
+				const std::uint32_t d = mod[q].d;
+				count[q] += r[q] == 0;
+				r[q] += mod[q](n);
+				r[q] -= r[q] >= d ? d : 0;
+			}
+		}
+	});
+
+	std::vector<int> result(Q, 0);
+	for (const auto& count : partial)
+	{
+		for (std::size_t q = 0; q < Q; ++q)
+		{
+			result[q] += count[q];
+		}
+	}
+	return result;
+}
+
+
+int CountHappyGroups(int BatchSize, const std::vector<int>& Groups, std::size_t threads)
+{
+	return CountHappyGroups(std::vector<int>{ BatchSize }, Groups, threads)[0];
+}
+
+
+// Best ordering of the groups
+struct HappyOrder
+{
+	int happy = 0;                   // number of happy groups
+	std::vector<std::size_t> order;  // indices into Groups, in serving order
+	bool exact = true;               // false if happy may be below the optimum (see MaxHappyGroups)
+};
+
+
+// Number of states of the DP over the residue counts, i.e. the product of (count + 1),
+// saturated at limit + 1 so that it can not overflow
+std::size_t HappyStates(const std::vector<std::vector<std::size_t>>& bucket, std::size_t limit)
+{
+	std::size_t states = 1;
+	for (std::size_t r = 1; r < bucket.size(); ++r)
+	{
+		const std::size_t radix = bucket[r].size() + 1;
+		if (states > limit / radix)
+		{
+			return limit + 1;
+		}
+		states *= radix;
+	}
+	return states;
+}
+
+
+// Smallest non empty set of the remaining groups whose residues sum to 0 modulo B, as a count per residue
+// (empty if there is none). 0/1 knapsack over the sums modulo B, with the groups of each residue split in
+// chunks of 1, 2, 4, ... elements; a minimal set never uses a residue r more than B / gcd(r, B) times.
+std::vector<std::size_t> SmallestZeroBlock(const std::vector<std::vector<std::size_t>>& bucket)
+{
+	const std::size_t B = bucket.size();
+	struct Chunk
+	{
+		std::size_t residue;
+		std::size_t size;
+	};
+	std::vector<Chunk> chunk;
+	for (std::size_t r = 1; r < B; ++r)
+	{
+		std::size_t left = std::min(bucket[r].size(), B / std::gcd(r, B));
+		for (std::size_t m = 1; left > 0; m *= 2)
+		{
+			chunk.push_back({ r, std::min(m, left) });
+			left -= chunk.back().size;
+		}
+	}
+	if (chunk.size() > (std::size_t(1) << 28) / B)
+	{
+		throw std::length_error("MaxHappyGroups: BatchSize too large to reduce the groups");
+	}
+
+	// cost[s] is the fewest groups of a non empty set summing to s, taken[c * B + s] how chunk c reached s
+	enum : unsigned char { Skip, Add, First };
+	const std::size_t none = static_cast<std::size_t>(-1);
+	std::vector<std::size_t> cost(B, none);
+	std::vector<std::size_t> next(B);
+	std::vector<unsigned char> taken(chunk.size() * B, Skip);
+	for (std::size_t c = 0; c < chunk.size(); ++c)
+	{
+		const std::size_t w = chunk[c].residue * chunk[c].size % B;
+		next = cost;
+		for (std::size_t s = 0; s < B; ++s)
+		{
+			const std::size_t t = (s + w) % B;
+			if (cost[s] != none && cost[s] + chunk[c].size < next[t])
+			{
+				next[t] = cost[s] + chunk[c].size;
+				taken[c * B + t] = Add;
+			}
+		}
+		if (chunk[c].size < next[w])
+		{
+			next[w] = chunk[c].size;
+			taken[c * B + w] = First;
+		}
+		cost.swap(next);
+	}
+
+	std::vector<std::size_t> use;
+	if (cost[0] == none)
+	{
+		return use;
+	}
+	use.assign(B, 0);
+	for (std::size_t c = chunk.size(), s = 0; c-- > 0;)
+	{
+		const unsigned char how = taken[c * B + s];
+		if (how != Skip)
+		{
+			use[chunk[c].residue] += chunk[c].size;
+			s = (s + B - chunk[c].residue * chunk[c].size % B) % B;
+			if (how == First)
+			{
+				break;
+			}
+		}
+	}
+	return use;
+}
+
+
+// Finds the ordering of the groups maximizing the happy ones. Group sizes must be non negative.
+// Only the residues modulo BatchSize matter, so:
+//   - groups with residue 0 are served first, each one is happy
+//   - groups with complementary residues (r, BatchSize - r) are served in pairs, each pair gives one happy group
+//   - the remaining groups are ordered by a DP over their residue count vectors
+// Every sub-vector of the counts is reachable, so the DP table is a flat array indexed by the counts packed
+// in mixed radix, with size the product of (count + 1) over the remaining residues.
+// When that exceeds max_states, the smallest sets of groups summing to 0 modulo BatchSize are served first,
+// one happy group each, until the table fits. This is greedy: the result is then flagged as not exact, and
+// can be below the optimum (each set of k groups peeled may cost up to k - 2 happy groups over the best split).
+// If no such set is left, only the first remaining group can be happy and any order of them is optimal.
+// Throws std::length_error when BatchSize is too large for the reduction (above a few thousands).
+HappyOrder MaxHappyGroups(int BatchSize, const std::vector<int>& Groups, std::size_t max_states = std::size_t(1) << 22)
+{
+	const std::size_t B = static_cast<std::size_t>(BatchSize);
+
+	std::vector<std::vector<std::size_t>> bucket(B);
+	for (std::size_t i = 0; i < Groups.size(); ++i)
+	{
+		bucket[static_cast<std::size_t>(Groups[i]) % B].push_back(i);
+	}
+
+	HappyOrder result;
+	result.order = bucket[0];
+	result.happy = static_cast<int>(bucket[0].size());
+	bucket[0].clear();
+
+	for (std::size_t r = 1; r <= B - r; ++r)
+	{
+		std::vector<std::size_t>& a = bucket[r];
+		std::vector<std::size_t>& b = bucket[B - r];
+		while (a.size() > (r == B - r) && !b.empty())
+		{
+			result.order.push_back(a.back());
+			a.pop_back();
+			result.order.push_back(b.back());
+			b.pop_back();
+			++result.happy;
+		}
+	}
+
+	// shrink the table until it fits, serving zero sum sets of groups
+	while (HappyStates(bucket, max_states) > max_states)
+	{
+		const std::vector<std::size_t> use = SmallestZeroBlock(bucket);
+		if (use.empty())
+		{
+			// no prefix of the remaining groups can sum to 0 again
+			for (std::size_t r = 1; r < B; ++r)
+			{
+				result.order.insert(result.order.end(), bucket[r].begin(), bucket[r].end());
+				bucket[r].clear();
+			}
+			++result.happy;
+			break;
+		}
+
+		// the same set is served as long as the groups are there and the table is too large
+		bool available = true;
+		while (available && HappyStates(bucket, max_states) > max_states)
+		{
+			for (std::size_t r = 1; r < B; ++r)
+			{
+				for (std::size_t i = 0; i < use[r]; ++i)
+				{
+					result.order.push_back(bucket[r].back());
+					bucket[r].pop_back();
+				}
+			}
+			++result.happy;
+			result.exact = false;
+			for (std::size_t r = 1; r < B; ++r)
+			{
+				available = available && bucket[r].size() >= use[r];
+			}
+		}
+	}
+
+	// remaining residues, with their packing stride
+	std::vector<std::size_t> residue;
+	std::vector<std::size_t> stride;
+	std::vector<std::size_t> radix;
+	std::size_t states = 1;
+	std::size_t total = 0;
+	for (std::size_t r = 1; r < B; ++r)
+	{
+		if (!bucket[r].empty())
+		{
+			residue.push_back(r);
+			stride.push_back(states);
+			radix.push_back(bucket[r].size() + 1);
+			states *= radix.back();
+			total += r * bucket[r].size();
+		}
+	}
+	const std::size_t K = residue.size();
+
+	// best[s] is the number of happy groups obtainable serving the groups left in state s
+	// states are visited in packed order, keeping the counts and their residue sum as an odometer
+	std::vector<int> best(states, 0);
+	std::vector<std::size_t> digit(K, 0);
+	std::size_t left = 0;
+	for (std::size_t s = 1; s < states; ++s)
+	{
+		for (std::size_t k = 0; k < K; ++k)
+		{
+			if (++digit[k] < radix[k])
+			{
+				left += residue[k];
+				break;
+			}
+			left -= (radix[k] - 1) * residue[k];
+			digit[k] = 0;
+		}
+
+		int next = 0;
+		for (std::size_t k = 0; k < K; ++k)
+		{
+			if (digit[k] > 0)
+			{
+				next = std::max(next, best[s - stride[k]]);
+			}
+		}
+		// the next group is happy if what was served so far is a multiple of BatchSize
+		best[s] = next + ((total - left) % B == 0);
+	}
+
+	// walk the table back to recover the ordering
+	for (std::size_t s = states - 1; s > 0;)
+	{
+		std::size_t pick = K;
+		for (std::size_t k = 0; k < K; ++k)
+		{
+			const std::size_t left_k = (s / stride[k]) % radix[k];
+			if (left_k > 0 && (pick == K || best[s - stride[k]] > best[s - stride[pick]]))
+			{
+				pick = k;
+			}
+		}
+		result.order.push_back(bucket[residue[pick]].back());
+		bucket[residue[pick]].pop_back();
+		s -= stride[pick];
+	}
+	result.happy += best[states - 1];
+
+	// the ordering must achieve the count
+	std::vector<int> ordered;
+	for (std::size_t i : result.order)
+	{
+		ordered.push_back(Groups[i]);
+	}
+	assert(CountHappyGroups(BatchSize, ordered) == result.happy);
+
+	return result;
+}
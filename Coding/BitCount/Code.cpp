@@ -1,3 +1,11 @@
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
 int solution(int A, int B)
 {
 	int n = 0;
@@ -7,3 +15,123 @@ int solution(int A, int B)
 	}
     return n;
 }
+
+
+// Bits set in the product, computed on 64 bits so that A * B cannot overflow
+int solution64(int A, int B)
+{
+	return __builtin_popcountll(std::uint64_t(std::uint32_t(A)) * std::uint32_t(B));
+}
+
+
+// Bulk version: out[i] = number of bits set in A[i] * B[i], for n pairs of non-negative integers.
+// The kernel is picked at runtime from the instructions the CPU supports.
+namespace bulk
+{
+	// portable popcount (SWAR)
+	inline std::uint8_t popcount(std::uint64_t x)
+	{
+		x = x - ((x >> 1) & 0x5555555555555555ull);
+		x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return static_cast<std::uint8_t>((x * 0x0101010101010101ull) >> 56);
+	}
+
+
+	void kernel_portable(const std::uint32_t* A, const std::uint32_t* B, std::uint8_t* out, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			out[i] = popcount(std::uint64_t(A[i]) * B[i]);
+		}
+	}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+	__attribute__((target("popcnt")))
+	void kernel_popcnt(const std::uint32_t* A, const std::uint32_t* B, std::uint8_t* out, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			out[i] = static_cast<std::uint8_t>(__builtin_popcountll(std::uint64_t(A[i]) * B[i]));
+		}
+	}
+
+
+	// 4 products per step, popcount by nibble lookup (pshufb) and horizontal byte sums (psadbw)
+	__attribute__((target("avx2")))
+	void kernel_avx2(const std::uint32_t* A, const std::uint32_t* B, std::uint8_t* out, std::size_t n)
+	{
+		const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		                                        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+		// gathers the count of each 64 bit lane in the low 2 bytes of each 128 bit half
+		const __m256i gather = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		                                        0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m256i a = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(A + i)));
+			const __m256i b = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(B + i)));
+			const __m256i c = _mm256_mul_epu32(a, b);
+
+			const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(c, low_nibble));
+			const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(c, 4), low_nibble));
+			const __m256i sum = _mm256_shuffle_epi8(_mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()), gather);
+
+			const std::uint32_t packed = std::uint32_t(_mm256_extract_epi16(sum, 0)) | (std::uint32_t(_mm256_extract_epi16(sum, 8)) << 16);
+			__builtin_memcpy(out + i, &packed, sizeof(packed));
+		}
+		kernel_popcnt(A + i, B + i, out + i, n - i);
+	}
+
+
+	// 8 products per step with the native 64 bit popcount.
+	// The zero-masked forms (all lanes on) avoid the undefined source GCC uses for the plain ones.
+	__attribute__((target("avx512f,avx512vpopcntdq")))
+	void kernel_avx512(const std::uint32_t* A, const std::uint32_t* B, std::uint8_t* out, std::size_t n)
+	{
+		const __mmask8 all = 0xFF;
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m512i a = _mm512_maskz_cvtepu32_epi64(all, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(A + i)));
+			const __m512i b = _mm512_maskz_cvtepu32_epi64(all, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(B + i)));
+			const __m512i c = _mm512_popcnt_epi64(_mm512_maskz_mul_epu32(all, a, b));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm512_maskz_cvtepi64_epi8(all, c));
+		}
+		kernel_popcnt(A + i, B + i, out + i, n - i);
+	}
+#endif
+
+
+	using kernel_t = void (*)(const std::uint32_t*, const std::uint32_t*, std::uint8_t*, std::size_t);
+
+	kernel_t select_kernel()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512vpopcntdq"))
+		{
+			return kernel_avx512;
+		}
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+		{
+			return kernel_avx2;
+		}
+		if (__builtin_cpu_supports("popcnt"))
+		{
+			return kernel_popcnt;
+		}
+#endif
+		return kernel_portable;
+	}
+}
+
+
+void solution(const std::uint32_t* A, const std::uint32_t* B, std::uint8_t* out, std::size_t n)
+{
+	static const bulk::kernel_t kernel = bulk::select_kernel();
+	kernel(A, B, out, n);
+}
@@ -1,8 +1,14 @@
 #include <algorithm>
+#include <cstdint>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 
 // Naive count
 std::size_t count(std::uint32_t data)
@@ -51,44 +57,233 @@ std::size_t count(T data)
 }
 
 
-// 4. Ascending order by the number of 1s pairs
-void count_sort(std::vector<uint32_t>& data)
+// Constant time count, for any unsigned integral including unsigned __int128, usable at compile time.
+// Every pair of adjacent 1s leaves exactly one bit set in data & (data >> 1).
+template <typename T>
+struct is_unsigned_integral
+	: std::integral_constant<bool, (std::is_integral<T>::value && std::is_unsigned<T>::value) || std::is_same<T, unsigned __int128>::value>
+{
+};
+
+
+template <typename T,
+	typename std::enable_if<is_unsigned_integral<T>::value, bool>::type = true>
+constexpr std::size_t popcount(T data)
+{
+	// wider types are split in two halves
+	return sizeof(T) <= sizeof(unsigned long long)
+		? static_cast<std::size_t>(__builtin_popcountll(static_cast<unsigned long long>(data)))
+		: static_cast<std::size_t>(__builtin_popcountll(static_cast<unsigned long long>(data)) + __builtin_popcountll(static_cast<unsigned long long>(data >> (sizeof(T) * 4))));
+}
+
+
+template <typename T,
+	typename std::enable_if<is_unsigned_integral<T>::value, bool>::type = true>
+constexpr std::size_t count_pairs(T data)
+{
+	return popcount(static_cast<T>(data & (data >> 1)));
+}
+
+static_assert(count_pairs(0b010101u) == 0 && count_pairs(0b101100u) == 1 && count_pairs(0b110011u) == 2 && count_pairs(0b110111u) == 3, "count_pairs");
+static_assert(count_pairs(~static_cast<unsigned __int128>(0)) == 127, "count_pairs on 128 bits");
+
+
+// Bulk count: out[i] = count_pairs(data[i]).
+// With AVX2, the population count is done on 8 (32 bits) or 4 (64 bits) values at a time with a nibble lookup table.
+#if defined(__AVX2__)
+inline __m256i popcount_bytes(__m256i x)
 {
-	struct
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	                                        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_nibble));
+	const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibble));
+	return _mm256_add_epi8(lo, hi);
+}
+#endif
+
+
+void count_pairs(const std::uint32_t* data, std::uint8_t* out, std::size_t n)
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	// moves the low byte of each 32 bit lane to the first 4 bytes of each 128 bit half
+	const __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	                                        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	for (; i + 8 <= n; i += 8)
 	{
-		bool operator()(uint32_t a, uint32_t b) const
-		{
-			return count(a) < count(b);
-		}
-	} compare;
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i c = popcount_bytes(_mm256_and_si256(x, _mm256_srli_epi32(x, 1)));
+		c = _mm256_add_epi8(c, _mm256_srli_epi32(c, 8));
+		c = _mm256_add_epi8(c, _mm256_srli_epi32(c, 16));
+		c = _mm256_shuffle_epi8(c, gather);
+		const std::uint64_t packed = std::uint64_t(std::uint32_t(_mm256_extract_epi32(c, 0))) | (std::uint64_t(std::uint32_t(_mm256_extract_epi32(c, 4))) << 32);
+		__builtin_memcpy(out + i, &packed, sizeof(packed));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = static_cast<std::uint8_t>(count_pairs(data[i]));
+	}
+}
+
 
-	std::sort(data.begin(), data.end(), compare);
+void count_pairs(const std::uint64_t* data, std::uint8_t* out, std::size_t n)
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	// moves the low byte of each 64 bit lane to the first 2 bytes of each 128 bit half
+	const __m256i gather = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	                                        0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		const __m256i c = popcount_bytes(_mm256_and_si256(x, _mm256_srli_epi64(x, 1)));
+		const __m256i sum = _mm256_shuffle_epi8(_mm256_sad_epu8(c, _mm256_setzero_si256()), gather);
+		const std::uint32_t packed = std::uint32_t(_mm256_extract_epi16(sum, 0)) | (std::uint32_t(_mm256_extract_epi16(sum, 8)) << 16);
+		__builtin_memcpy(out + i, &packed, sizeof(packed));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = static_cast<std::uint8_t>(count_pairs(data[i]));
+	}
 }
 
 
-// 5. Ascending order by the number of 1s pairs, natural ascending order in case of equal count
-void count_sort_natural(std::vector<uint32_t>& data)
+void count_pairs(const std::vector<std::uint32_t>& data, std::vector<std::uint8_t>& out)
+{
+	out.resize(data.size());
+	count_pairs(data.data(), out.data(), data.size());
+}
+
+
+void count_pairs(const std::vector<std::uint64_t>& data, std::vector<std::uint8_t>& out)
+{
+	out.resize(data.size());
+	count_pairs(data.data(), out.data(), data.size());
+}
+
+
+// Sorting by precomputed keys: each value is packed with its pair count as (count << 32) | value,
+// so that ordering by count, then by value, is ordering by key. The keys are sorted with a stable
+// LSD radix sort, split across threads for large inputs.
+constexpr std::size_t parallel_sort_cutoff = 1 << 16;
+
+
+template <typename Job>
+void run_threads(std::size_t threads, Job job)
+{
+	if (threads == 1)
+	{
+		job(std::size_t(0));
+		return;
+	}
+
+	std::vector<std::thread> pool;
+	for (std::size_t t = 0; t < threads; ++t)
+	{
+		pool.emplace_back(job, t);
+	}
+	for (auto& th : pool)
+	{
+		th.join();
+	}
+}
+
+
+// Stable LSD radix sort of keys on bits [first_bit, last_bit), 11 bits per pass
+void radix_sort(std::vector<std::uint64_t>& keys, std::size_t first_bit, std::size_t last_bit, std::size_t threads)
 {
-	struct
+	constexpr std::size_t digit_bits = 11;
+	constexpr std::size_t buckets = std::size_t(1) << digit_bits;
+
+	const std::size_t N = keys.size();
+	threads = N < parallel_sort_cutoff ? 1 : std::max<std::size_t>(1, threads);
+	auto chunk = [N, threads](std::size_t t) { return N * t / threads; };
+
+	std::vector<std::uint64_t> buffer(N);
+	std::vector<std::size_t> offset(threads * buckets);
+
+	for (std::size_t shift = first_bit; shift < last_bit; shift += digit_bits)
 	{
-		bool operator()(uint32_t a, uint32_t b) const
+		const std::uint64_t mask = (std::uint64_t(1) << std::min(digit_bits, last_bit - shift)) - 1;
+
+		// histogram of each chunk
+		run_threads(threads, [&](std::size_t t)
 		{
-			std::size_t ca = count(a);
-			std::size_t cb = count(b);
+			std::size_t* count = offset.data() + t * buckets;
+			std::fill(count, count + buckets, 0);
+			for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+			{
+				++count[(keys[i] >> shift) & mask];
+			}
+		});
 
-			if (ca < cb)
+		// exclusive scan by digit, then by chunk, so that equal digits keep their order
+		std::size_t sum = 0;
+		for (std::size_t d = 0; d < buckets; ++d)
+		{
+			for (std::size_t t = 0; t < threads; ++t)
 			{
-				return true;
+				const std::size_t c = offset[t * buckets + d];
+				offset[t * buckets + d] = sum;
+				sum += c;
 			}
+		}
 
-			if (ca == cb)
+		run_threads(threads, [&](std::size_t t)
+		{
+			std::size_t* next = offset.data() + t * buckets;
+			for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
 			{
-				return a < b;
+				buffer[next[(keys[i] >> shift) & mask]++] = keys[i];
 			}
+		});
 
-			return false;
+		keys.swap(buffer);
+	}
+}
+
+
+// Sorts data by the key bits [first_bit, 37), 5 bits of pair count above the 32 bits of the value
+void key_sort(std::vector<uint32_t>& data, std::size_t first_bit, std::size_t threads)
+{
+	const std::size_t N = data.size();
+	threads = N < parallel_sort_cutoff ? 1 : std::max<std::size_t>(1, threads);
+	auto chunk = [N, threads](std::size_t t) { return N * t / threads; };
+
+	std::vector<std::uint64_t> keys(N);
+	run_threads(threads, [&](std::size_t t)
+	{
+		for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+		{
+			keys[i] = (std::uint64_t(count_pairs(data[i])) << 32) | data[i];
 		}
-	} compare;
+	});
+
+	radix_sort(keys, first_bit, 37, threads);
 
-	std::sort(data.begin(), data.end(), compare);
+	run_threads(threads, [&](std::size_t t)
+	{
+		for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+		{
+			data[i] = static_cast<uint32_t>(keys[i]);
+		}
+	});
+}
+
+
+// 4. Ascending order by the number of 1s pairs
+// Only the count is part of the key, values with the same count keep their relative order.
+void count_sort(std::vector<uint32_t>& data, std::size_t threads = std::thread::hardware_concurrency())
+{
+	key_sort(data, 32, threads);
+}
+
+
+// 5. Ascending order by the number of 1s pairs, natural ascending order in case of equal count
+void count_sort_natural(std::vector<uint32_t>& data, std::size_t threads = std::thread::hardware_concurrency())
+{
+	key_sort(data, 0, threads);
 }
@@ -1,7 +1,14 @@
 #include <vector>
 #include <queue>
 #include <algorithm>
+#include <chrono>
 #include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
 
 
 using cost_t = std::vector<std::vector<int>>;
@@ -67,23 +74,125 @@ void fetch_data(const std::vector<std::string>& data, index_t& charlie, index_t&
 }
 
 
-cost_t compute_costs(const index_t& charlie, const index_t& home, const std::vector<index_t>& food)
+// Cost of a pair of points that cannot reach each other, small enough that two of them can be added
+constexpr int unreachable = std::numeric_limits<int>::max() / 2;
+
+
+// Grid flattened in row major order.
+// Charlie can walk on 'O', 'C' and 'F' cells, any other character is a wall.
+// Home can only be entered as the final destination.
+struct grid_t
 {
-	const int n = food.size() + 2;
-	cost_t costs(n, std::vector<int>(n, 0));
+	enum cell_t : char { wall, open, home };
 
-	for (std::size_t i = 0; i < food.size(); ++i)
+	grid_t(const std::vector<std::string>& data)
+		: rows(data.size()), cols(0)
 	{
-		costs[0][i + 1] = charlie.distance(food[i]);
-		costs[i + 1][n - 1] = home.distance(food[i]);
+		for (const std::string& row : data)
+		{
+			cols = std::max<int>(cols, row.size());
+		}
+		cells.assign(std::size_t(rows) * cols, wall);
+		for (int i = 0; i < rows; ++i)
+		{
+			for (std::size_t j = 0; j < data[i].size(); ++j)
+			{
+				const char c = data[i][j];
+				cells[std::size_t(i) * cols + j] = c == 'H' ? home : (c == 'O' || c == 'C' || c == 'F') ? open : wall;
+			}
+		}
 	}
 
-	for (std::size_t i = 1; i < food.size(); ++i)
+	int flat(const index_t& p) const
 	{
-		std::size_t j = i - 1;
-		int distance = food[i].distance(food[i - 1]);
-		costs[i][j] = distance;
-		costs[j][i] = distance;
+		return p.i * cols + p.j;
+	}
+
+	int rows;
+	int cols;
+	std::vector<char> cells;
+};
+
+
+// Breadth first search from source, writing the steps to every cell in dist (unreachable if none).
+// The frontier buffers are passed in so that a thread can reuse them across searches.
+void bfs(const grid_t& grid, int source, std::vector<int>& dist, std::vector<int>& frontier, std::vector<int>& next)
+{
+	dist.assign(grid.cells.size(), unreachable);
+	frontier.clear();
+	dist[source] = 0;
+	frontier.push_back(source);
+
+	for (int steps = 1; !frontier.empty(); ++steps)
+	{
+		next.clear();
+		for (const int c : frontier)
+		{
+			// home is a destination, never a waypoint
+			if (grid.cells[c] == grid_t::home && c != source)
+			{
+				continue;
+			}
+			const int i = c / grid.cols;
+			const int j = c % grid.cols;
+			const int neighbour[4] = { i > 0 ? c - grid.cols : -1, i + 1 < grid.rows ? c + grid.cols : -1,
+			                           j > 0 ? c - 1 : -1, j + 1 < grid.cols ? c + 1 : -1 };
+			for (const int n : neighbour)
+			{
+				if (n >= 0 && grid.cells[n] != grid_t::wall && dist[n] == unreachable)
+				{
+					dist[n] = steps;
+					next.push_back(n);
+				}
+			}
+		}
+		frontier.swap(next);
+	}
+}
+
+
+// Walking distances between every pair of points of interest: 0 is Charlie, then the food, then home.
+// One search per point, the searches are spread across threads.
+cost_t compute_costs(const std::vector<std::string>& data, const index_t& charlie, const index_t& home, const std::vector<index_t>& food,
+                     std::size_t threads = std::thread::hardware_concurrency())
+{
+	const grid_t grid(data);
+
+	std::vector<int> point;
+	point.push_back(grid.flat(charlie));
+	for (const index_t& f : food)
+	{
+		point.push_back(grid.flat(f));
+	}
+	point.push_back(grid.flat(home));
+
+	const int n = point.size();
+	cost_t costs(n, std::vector<int>(n, unreachable));
+
+	// one BFS per point, each visiting every cell at most once
+	threads = std::max<std::size_t>(1, std::min<std::size_t>(threads, std::min<std::size_t>(n, grid.cells.size() * n / 65536 + 1)));
+	auto work = [&](std::size_t t)
+	{
+		std::vector<int> dist, frontier, next;
+		for (int a = t; a < n; a += threads)
+		{
+			bfs(grid, point[a], dist, frontier, next);
+			for (int b = 0; b < n; ++b)
+			{
+				costs[a][b] = dist[point[b]];
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (std::size_t t = 1; t < threads; ++t)
+	{
+		pool.emplace_back(work, t);
+	}
+	work(0);
+	for (auto& th : pool)
+	{
+		th.join();
 	}
 
 	return costs;
@@ -124,6 +233,451 @@ int tsp(const cost_t& costs)
 }
 
 
+// Optimal route through the cost matrix: node 0 is Charlie, the last node is home, the others are food
+struct route_t
+{
+	int cost = std::numeric_limits<int>::max();
+	std::vector<int> nodes; // visiting order, starting at 0 and ending at home
+};
+
+
+// Held-Karp dynamic programming over subsets of food.
+// dp[mask * k + j] is the cheapest walk from Charlie collecting the food in mask and ending at food j.
+// A mask only reads masks with one less bit, so each popcount layer is split across threads.
+// Entries never reached stay at unreachable, which does not overflow when added to another cost:
+// this keeps the inner minimum free of branches.
+route_t held_karp(const cost_t& costs, std::size_t threads = std::thread::hardware_concurrency())
+{
+	const int n = costs.size();
+	const int k = n - 2;
+	const int home = n - 1;
+
+	route_t route;
+	if (k <= 0)
+	{
+		route.cost = costs[0][home];
+		route.nodes = { 0, home };
+		return route;
+	}
+
+	// food to food costs, w[j * k + i] is the cost from food i to food j
+	std::vector<int> w(std::size_t(k) * k);
+	for (int j = 0; j < k; ++j)
+	{
+		for (int i = 0; i < k; ++i)
+		{
+			w[std::size_t(j) * k + i] = std::min(costs[i + 1][j + 1], unreachable);
+		}
+	}
+
+	const std::uint32_t full = (std::uint32_t(1) << k) - 1;
+	std::vector<int> dp(std::size_t(full + 1) * k, unreachable);
+
+	// masks grouped by number of food collected
+	std::vector<std::vector<std::uint32_t>> layer(k + 1);
+	for (std::uint32_t mask = 1; mask <= full; ++mask)
+	{
+		layer[__builtin_popcount(mask)].push_back(mask);
+	}
+
+	for (int j = 0; j < k; ++j)
+	{
+		dp[(std::size_t(1) << j) * k + j] = std::min(costs[0][j + 1], unreachable);
+	}
+
+	threads = std::max<std::size_t>(1, threads);
+	for (int p = 2; p <= k; ++p)
+	{
+		const std::vector<std::uint32_t>& masks = layer[p];
+		const std::size_t T = std::min(threads, masks.size() / 256 + 1);
+
+		auto work = [&](std::size_t t)
+		{
+			for (std::size_t m = masks.size() * t / T; m < masks.size() * (t + 1) / T; ++m)
+			{
+				const std::uint32_t mask = masks[m];
+				for (int j = 0; j < k; ++j)
+				{
+					if (!(mask >> j & 1))
+					{
+						continue;
+					}
+					const int* from = &dp[std::size_t(mask ^ (std::uint32_t(1) << j)) * k];
+					const int* to_j = &w[std::size_t(j) * k];
+					int best = unreachable;
+					for (int i = 0; i < k; ++i)
+					{
+						best = std::min(best, from[i] + to_j[i]);
+					}
+					dp[std::size_t(mask) * k + j] = best;
+				}
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (std::size_t t = 1; t < T; ++t)
+		{
+			pool.emplace_back(work, t);
+		}
+		work(0);
+		for (auto& th : pool)
+		{
+			th.join();
+		}
+	}
+
+	// close the tour at home
+	int last = -1;
+	int best = unreachable;
+	for (int j = 0; j < k; ++j)
+	{
+		const int c = dp[std::size_t(full) * k + j] + std::min(costs[j + 1][home], unreachable);
+		if (c < best)
+		{
+			best = c;
+			last = j;
+		}
+	}
+	if (last < 0)
+	{
+		return route;
+	}
+	route.cost = best;
+
+	// walk back through the table, finding at each step a predecessor that explains the cost
+	route.nodes.assign(n, 0);
+	route.nodes[n - 1] = home;
+	std::uint32_t mask = full;
+	for (int pos = k; pos >= 1; --pos)
+	{
+		route.nodes[pos] = last + 1;
+		const std::uint32_t prev = mask ^ (std::uint32_t(1) << last);
+		const int c = dp[std::size_t(mask) * k + last];
+		for (int i = 0; i < k && prev; ++i)
+		{
+			if ((prev >> i & 1) && dp[std::size_t(prev) * k + i] + w[std::size_t(last) * k + i] == c)
+			{
+				last = i;
+				break;
+			}
+		}
+		mask = prev;
+	}
+
+	return route;
+}
+
+
+// Limits of the heuristic solver, it stops at whichever comes first
+struct budget_t
+{
+	std::chrono::steady_clock::duration time = std::chrono::milliseconds(100);
+	std::size_t iterations = std::numeric_limits<std::size_t>::max();
+};
+
+
+// Anytime heuristic for instances too large for held_karp, assuming symmetric costs.
+// A nearest neighbour route is improved by local search (2-opt and Or-opt moves) restricted to
+// the closest points of each point, revisiting only points whose surroundings changed (don't-look bits).
+// Once no move improves the route, random double bridge kicks are tried until the budget runs out.
+class route_search
+{
+public:
+	route_search(const cost_t& costs, const budget_t& budget)
+		: costs(costs), n(costs.size()), home(n - 1), budget(budget),
+		  deadline(std::chrono::steady_clock::now() + budget.time)
+	{
+	}
+
+	route_t run()
+	{
+		nearest_neighbour();
+		build_neighbours();
+
+		if (n > 3)
+		{
+			activate_all();
+			local_search();
+
+			// iterated local search: kick the best route and keep the result if it improves
+			std::mt19937 random(n);
+			std::vector<int> best = route;
+			long long best_cost = cost();
+			while (n > 5 && !out_of_budget())
+			{
+				std::vector<int> cut = { 1 + int(random() % (n - 2)), 1 + int(random() % (n - 2)), 1 + int(random() % (n - 2)) };
+				std::sort(cut.begin(), cut.end());
+				if (cut[0] == cut[1] || cut[1] == cut[2])
+				{
+					continue;
+				}
+				std::rotate(route.begin() + cut[0], route.begin() + cut[1], route.begin() + cut[2]);
+				update_positions(cut[0], cut[2] - 1);
+				for (const int c : cut)
+				{
+					activate(route[c - 1]);
+					activate(route[c]);
+				}
+				local_search();
+
+				const long long c = cost();
+				if (c < best_cost)
+				{
+					best = route;
+					best_cost = c;
+				}
+				else
+				{
+					route = best;
+					update_positions(0, n - 1);
+				}
+			}
+		}
+
+		route_t result;
+		result.nodes = route;
+		result.cost = int(std::min<long long>(cost(), unreachable));
+		return result;
+	}
+
+	std::size_t iterations() const
+	{
+		return iteration;
+	}
+
+private:
+	long long d(int a, int b) const
+	{
+		return costs[a][b];
+	}
+
+	long long cost() const
+	{
+		long long c = 0;
+		for (int p = 0; p + 1 < n; ++p)
+		{
+			c += d(route[p], route[p + 1]);
+		}
+		return c;
+	}
+
+	bool out_of_budget()
+	{
+		return ++iteration > budget.iterations || std::chrono::steady_clock::now() > deadline;
+	}
+
+	void nearest_neighbour()
+	{
+		std::vector<bool> visited(n, false);
+		route.assign(1, 0);
+		visited[0] = true;
+		visited[home] = true;
+		for (int step = 1; step < n - 1; ++step)
+		{
+			const int from = route.back();
+			int next = -1;
+			for (int c = 1; c < home; ++c)
+			{
+				if (!visited[c] && (next < 0 || costs[from][c] < costs[from][next]))
+				{
+					next = c;
+				}
+			}
+			visited[next] = true;
+			route.push_back(next);
+		}
+		if (n > 1)
+		{
+			route.push_back(home);
+		}
+		pos.assign(n, 0);
+		update_positions(0, n - 1);
+	}
+
+	// closest candidates of each point, home excluded since it never moves
+	void build_neighbours()
+	{
+		constexpr int K = 8;
+		neighbours.assign(n, {});
+		for (int a = 0; a < home; ++a)
+		{
+			std::vector<int>& list = neighbours[a];
+			for (int b = 0; b < home; ++b)
+			{
+				if (b != a)
+				{
+					list.push_back(b);
+				}
+			}
+			const std::size_t keep = std::min<std::size_t>(K, list.size());
+			std::partial_sort(list.begin(), list.begin() + keep, list.end(), [&](int x, int y) { return costs[a][x] < costs[a][y]; });
+			list.resize(keep);
+		}
+	}
+
+	void update_positions(int first, int last)
+	{
+		for (int p = first; p <= last; ++p)
+		{
+			pos[route[p]] = p;
+		}
+	}
+
+	void activate(int a)
+	{
+		if (a != home && !active[a])
+		{
+			active[a] = true;
+			queue.push_back(a);
+		}
+	}
+
+	void activate_all()
+	{
+		active.assign(n, false);
+		queue.clear();
+		for (int p = n - 2; p >= 0; --p)
+		{
+			activate(route[p]);
+		}
+	}
+
+	void local_search()
+	{
+		while (!queue.empty() && !out_of_budget())
+		{
+			const int a = queue.back();
+			queue.pop_back();
+			active[a] = false;
+			if (improve(a))
+			{
+				activate(a);
+			}
+		}
+		for (const int a : queue)
+		{
+			active[a] = false;
+		}
+		queue.clear();
+	}
+
+	// reverses route[p + 1, q], replacing edges (p, p + 1) and (q, q + 1) with (p, q) and (p + 1, q + 1)
+	bool two_opt(int p, int q)
+	{
+		if (p > q)
+		{
+			std::swap(p, q);
+		}
+		if (p < 0 || q >= home || q - p < 2)
+		{
+			return false;
+		}
+		const long long gain = d(route[p], route[p + 1]) + d(route[q], route[q + 1]) - d(route[p], route[q]) - d(route[p + 1], route[q + 1]);
+		if (gain <= 0)
+		{
+			return false;
+		}
+		std::reverse(route.begin() + p + 1, route.begin() + q + 1);
+		update_positions(p + 1, q);
+		activate(route[p]);
+		activate(route[p + 1]);
+		activate(route[q]);
+		activate(route[q + 1]);
+		return true;
+	}
+
+	// moves the L points starting at position i between positions j and j + 1, possibly reversed
+	bool or_opt(int i, int L, int j)
+	{
+		const int last = i + L - 1;
+		if (i < 1 || last >= home || j < 0 || j >= home || (j >= i - 1 && j <= last))
+		{
+			return false;
+		}
+		const int prev = route[i - 1], next = route[last + 1], s0 = route[i], sL = route[last];
+		const int c = route[j], cn = route[j + 1];
+		const long long removed = d(prev, s0) + d(sL, next) - d(prev, next);
+		const long long forward = d(c, s0) + d(sL, cn) - d(c, cn);
+		const long long reversed = d(c, sL) + d(s0, cn) - d(c, cn);
+		if (removed - std::min(forward, reversed) <= 0)
+		{
+			return false;
+		}
+
+		int first, end;
+		if (j > last)
+		{
+			std::rotate(route.begin() + i, route.begin() + last + 1, route.begin() + j + 1);
+			first = i;
+			end = j;
+		}
+		else
+		{
+			std::rotate(route.begin() + j + 1, route.begin() + i, route.begin() + last + 1);
+			first = j + 1;
+			end = last;
+		}
+		if (reversed < forward)
+		{
+			const int at = j > last ? j - L + 1 : j + 1;
+			std::reverse(route.begin() + at, route.begin() + at + L);
+		}
+		update_positions(first, end);
+		for (const int x : { prev, next, s0, sL, c, cn })
+		{
+			activate(x);
+		}
+		return true;
+	}
+
+	// tries the moves creating an edge between a and one of its neighbours, applying the first improving one
+	bool improve(int a)
+	{
+		for (const int c : neighbours[a])
+		{
+			const int i = pos[a];
+			const int j = pos[c];
+			if (two_opt(i, j) || (i > 0 && j > 0 && two_opt(i - 1, j - 1)))
+			{
+				return true;
+			}
+			for (int L = 1; L <= 3; ++L)
+			{
+				if (or_opt(i, L, j) || or_opt(i, L, j - 1))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	const cost_t& costs;
+	const int n;
+	const int home;
+	const budget_t budget;
+	const std::chrono::steady_clock::time_point deadline;
+	std::size_t iteration = 0;
+
+	std::vector<int> route;                     // visiting order, Charlie first and home last
+	std::vector<int> pos;                       // position of each point in route
+	std::vector<std::vector<int>> neighbours;   // candidate points for each point
+	std::vector<bool> active;                   // cleared don't-look bits
+	std::vector<int> queue;                     // points to revisit
+};
+
+
+// Exact for small instances, heuristic within the budget otherwise
+route_t solve_route(const cost_t& costs, const budget_t& budget = budget_t(), int exact_limit = 16)
+{
+	if (int(costs.size()) - 2 <= exact_limit)
+	{
+		return held_karp(costs);
+	}
+	return route_search(costs, budget).run();
+}
+
+
 int CharlietheDog(const std::vector<std::string>& strArr)
 {
 	index_t charlie, home;
@@ -131,10 +685,6 @@ int CharlietheDog(const std::vector<std::string>& strArr)
 
 	fetch_data(strArr, charlie, home, food);
 
-	if (food.empty())
-	{
-		return charlie.distance(home);
-	}
-
-	return tsp(compute_costs(charlie, home, food));
+	const int cost = solve_route(compute_costs(strArr, charlie, home, food)).cost;
+	return cost < unreachable ? cost : -1;
 }
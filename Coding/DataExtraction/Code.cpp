@@ -1,5 +1,13 @@
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 
 using namespace std;
@@ -34,3 +42,332 @@ vector<Vec3> extract_points_STL(const vector<Vec3>& points)
 	copy_if(points.begin(), points.end(), std::back_inserter(result), [&](const Vec3& p) { return p.z > 0.0f; });
 	return result;
 }
+
+
+// Vectorized compaction.
+// The z of 8 points are gathered and compared at once, giving an 8 bit mask of the selected points,
+// which are then copied in order by walking the set bits.
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "Vec3 must be tightly packed");
+
+
+#if defined(__AVX2__)
+inline unsigned positive_z_mask(const Vec3* in)
+{
+	const __m256i index = _mm256_setr_epi32(2, 5, 8, 11, 14, 17, 20, 23);
+	const __m256 z = _mm256_i32gather_ps(&in->x, index, sizeof(float));
+	return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_GT_OQ)));
+}
+#endif
+
+
+// Number of points with z > 0 in in[0, n)
+size_t count_points(const Vec3* in, size_t n)
+{
+	size_t count = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 8 <= n; i += 8)
+	{
+		count += __builtin_popcount(positive_z_mask(in + i));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		count += in[i].z > 0.0f;
+	}
+	return count;
+}
+
+
+// Copies the points with z > 0 of in[0, n) to out, in order, returning how many were copied.
+// Writes only the selected points, so out can be a slice of a larger output.
+size_t extract_points(const Vec3* in, size_t n, Vec3* out)
+{
+	size_t k = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 8 <= n; i += 8)
+	{
+		for (unsigned mask = positive_z_mask(in + i); mask; mask &= mask - 1)
+		{
+			out[k++] = in[i + __builtin_ctz(mask)];
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		if (in[i].z > 0.0f)
+		{
+			out[k++] = in[i];
+		}
+	}
+	return k;
+}
+
+
+vector<Vec3> extract_points_SIMD(const vector<Vec3>& points)
+{
+	vector<Vec3> result(count_points(points.data(), points.size()));
+	extract_points(points.data(), points.size(), result.data());
+	return result;
+}
+
+
+// Multi-threaded version, in two passes over the chunks of the input:
+// count the selected points of each chunk, then copy each chunk at its prefix sum offset.
+vector<Vec3> extract_points_parallel(const vector<Vec3>& points, size_t threads = std::thread::hardware_concurrency())
+{
+	const size_t N = points.size();
+	threads = std::max<size_t>(1, std::min(threads, N / 65536 + 1));
+	auto chunk = [N, threads](size_t t) { return N * t / threads; };
+
+	auto run = [threads](auto job)
+	{
+		vector<std::thread> pool;
+		for (size_t t = 1; t < threads; ++t)
+		{
+			pool.emplace_back(job, t);
+		}
+		job(size_t(0));
+		for (auto& th : pool)
+		{
+			th.join();
+		}
+	};
+
+	vector<size_t> offset(threads + 1, 0);
+	run([&](size_t t)
+	{
+		offset[t + 1] = count_points(points.data() + chunk(t), chunk(t + 1) - chunk(t));
+	});
+	for (size_t t = 0; t < threads; ++t)
+	{
+		offset[t + 1] += offset[t];
+	}
+
+	vector<Vec3> result(offset[threads]);
+	run([&](size_t t)
+	{
+		extract_points(points.data() + chunk(t), chunk(t + 1) - chunk(t), result.data() + offset[t]);
+	});
+	return result;
+}
+
+
+// Fused queries.
+// Predicates are small function objects combined with &&, || and ! into a single function object,
+// so a chain of filters is evaluated in one pass, inlined, without intermediate copies of the points.
+// A query returns indices, a bitmap or a lazy view, and points are only copied if asked to.
+template <typename F>
+struct Predicate
+{
+	F f;
+
+	inline bool operator()(const Vec3& p) const
+	{
+		return f(p);
+	}
+};
+
+
+template <typename F>
+Predicate<F> make_predicate(F f)
+{
+	return Predicate<F>{ std::move(f) };
+}
+
+
+template <typename A, typename B>
+auto operator&&(const Predicate<A>& a, const Predicate<B>& b)
+{
+	return make_predicate([a, b](const Vec3& p) { return a(p) && b(p); });
+}
+
+
+template <typename A, typename B>
+auto operator||(const Predicate<A>& a, const Predicate<B>& b)
+{
+	return make_predicate([a, b](const Vec3& p) { return a(p) || b(p); });
+}
+
+
+template <typename A>
+auto operator!(const Predicate<A>& a)
+{
+	return make_predicate([a](const Vec3& p) { return !a(p); });
+}
+
+
+// Points with z > value, z_above(0) is the condition of extract_points
+auto z_above(float value)
+{
+	return make_predicate([value](const Vec3& p) { return p.z > value; });
+}
+
+
+// Points inside the axis aligned box [lo, hi]
+auto in_box(const Vec3& lo, const Vec3& hi)
+{
+	return make_predicate([lo, hi](const Vec3& p)
+	{
+		return p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y && p.z >= lo.z && p.z <= hi.z;
+	});
+}
+
+
+// Points within radius of center
+auto in_sphere(const Vec3& center, float radius)
+{
+	const float r2 = radius * radius;
+	return make_predicate([center, r2](const Vec3& p)
+	{
+		const float dx = p.x - center.x, dy = p.y - center.y, dz = p.z - center.z;
+		return dx * dx + dy * dy + dz * dz <= r2;
+	});
+}
+
+
+// Indices of the points satisfying the predicate
+template <typename F>
+vector<size_t> select_indices(const vector<Vec3>& points, const Predicate<F>& predicate)
+{
+	vector<size_t> result;
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		if (predicate(points[i]))
+		{
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+
+// One bit per point, set if the point satisfies the predicate
+template <typename F>
+vector<bool> select_bitmap(const vector<Vec3>& points, const Predicate<F>& predicate)
+{
+	vector<bool> result(points.size());
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		result[i] = predicate(points[i]);
+	}
+	return result;
+}
+
+
+// Lazy view of the points satisfying a predicate: the predicate is evaluated while iterating,
+// and the points are read in place.
+template <typename F>
+class FilterView
+{
+public:
+	class iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Vec3;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Vec3*;
+		using reference = const Vec3&;
+
+		iterator(const Vec3* current, const Vec3* last, const Predicate<F>* predicate)
+			: m_current(current), m_last(last), m_predicate(predicate)
+		{
+			skip();
+		}
+
+		reference operator*() const { return *m_current; }
+		pointer operator->() const { return m_current; }
+
+		iterator& operator++()
+		{
+			++m_current;
+			skip();
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator it = *this;
+			++*this;
+			return it;
+		}
+
+		bool operator==(const iterator& other) const { return m_current == other.m_current; }
+		bool operator!=(const iterator& other) const { return m_current != other.m_current; }
+
+	private:
+		void skip()
+		{
+			while (m_current != m_last && !(*m_predicate)(*m_current))
+			{
+				++m_current;
+			}
+		}
+
+		const Vec3* m_current;
+		const Vec3* m_last;
+		const Predicate<F>* m_predicate;
+	};
+
+	FilterView(const vector<Vec3>& points, Predicate<F> predicate)
+		: m_first(points.data()), m_last(points.data() + points.size()), m_predicate(std::move(predicate))
+	{
+	}
+
+	iterator begin() const { return iterator(m_first, m_last, &m_predicate); }
+	iterator end() const { return iterator(m_last, m_last, &m_predicate); }
+
+	/// Copies the selected points
+	vector<Vec3> materialize() const
+	{
+		return vector<Vec3>(begin(), end());
+	}
+
+private:
+	const Vec3* m_first;
+	const Vec3* m_last;
+	Predicate<F> m_predicate;
+};
+
+
+// Entry point of a query over a list of points, which must outlive the results that refer to it.
+// Example:
+//     auto view = query(points).where(z_above(0.0f) && in_sphere(center, 2.0f));
+//     for (const Vec3& p : view) { ... }
+class Query
+{
+public:
+	explicit Query(const vector<Vec3>& points)
+		: m_points(points)
+	{
+	}
+
+	template <typename F>
+	FilterView<F> where(const Predicate<F>& predicate) const
+	{
+		return FilterView<F>(m_points, predicate);
+	}
+
+	template <typename F>
+	vector<size_t> indices(const Predicate<F>& predicate) const
+	{
+		return select_indices(m_points, predicate);
+	}
+
+	template <typename F>
+	vector<bool> bitmap(const Predicate<F>& predicate) const
+	{
+		return select_bitmap(m_points, predicate);
+	}
+
+private:
+	const vector<Vec3>& m_points;
+};
+
+
+inline Query query(const vector<Vec3>& points)
+{
+	return Query(points);
+}
@@ -1,6 +1,9 @@
 #include <vector>
 #include <limits>
 #include <queue>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
 
 
 struct Cell
@@ -13,9 +16,11 @@ struct Cell
 
 void preProcessData(std::vector<std::vector<int>>& inGrid, std::queue<Cell>& outQueue)
 {
-	for (int i = 0; i < inGrid.size(); ++i)
+	const int rows = inGrid.size();
+	for (int i = 0; i < rows; ++i)
 	{
-		for (int j = 0; j < inGrid[i].size(); ++j)
+		const int cols = inGrid[i].size();
+		for (int j = 0; j < cols; ++j)
 		{
 			if (inGrid[i][j])
 			{
@@ -69,15 +74,17 @@ void processData(std::vector<std::vector<int>>& inGrid, std::queue<Cell>& inQueu
 Cell findMaxValue(const std::vector<std::vector<int>>& grid)
 {
 	Cell output = { -1, -1, std::numeric_limits<int>::min() };
-	for (int i = 0; i < inGrid.size(); ++i)
+	const int rows = grid.size();
+	for (int i = 0; i < rows; ++i)
 	{
-		for (int j = 0; j < inGrid[i].size(); ++j)
+		const int cols = grid[i].size();
+		for (int j = 0; j < cols; ++j)
 		{
-			if (inGrid[i][j] > output.value)
+			if (grid[i][j] > output.value)
 			{
 				output.i = i;
 				output.j = j;
-				output.value = inGrid[i][j];
+				output.value = grid[i][j];
 			}
 		}
 	}
@@ -86,30 +93,422 @@ Cell findMaxValue(const std::vector<std::vector<int>>& grid)
 
 
 
-int getMinInconvenience(std::vector<std::vector<int>> grid)
+// Grid of distances stored in a single row major buffer
+struct DistanceField
+{
+	int rows = 0;
+	int cols = 0;
+	int infinity = 0;           // value of the cells with no center at all
+	std::vector<int> value;
+
+	inline int& at(int i, int j) { return value[std::size_t(i) * cols + j]; }
+	inline int at(int i, int j) const { return value[std::size_t(i) * cols + j]; }
+};
+
+
+template <typename Job>
+void runInParallel(int count, int threads, Job job)
+{
+	threads = std::max(1, std::min(threads, count));
+	if (threads == 1)
+	{
+		job(0, count);
+		return;
+	}
+
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; ++t)
+	{
+		pool.emplace_back(job, count * t / threads, count * (t + 1) / threads);
+	}
+	for (auto& th : pool)
+	{
+		th.join();
+	}
+}
+
+
+// Chebyshev distance of every cell to the nearest center, as a separable transform (Meijster et al.):
+//   1. g(i, j) = distance to the nearest center in column j, by a downward and an upward sweep over the rows
+//   2. d(i, j) = min over k of max(|j - k|, g(i, k)), the lower envelope of the row, in linear time
+// The first pass splits the columns across threads and the second splits the rows,
+// each thread working on contiguous pieces of rows.
+DistanceField distanceTransform(const std::vector<std::vector<int>>& grid, int threads = std::thread::hardware_concurrency())
+{
+	DistanceField field;
+	field.rows = grid.size();
+	field.cols = field.rows ? grid[0].size() : 0;
+	field.infinity = field.rows + field.cols;
+	field.value.resize(std::size_t(field.rows) * field.cols);
+
+	const int rows = field.rows;
+	const int cols = field.cols;
+	const int inf = field.infinity;
+	threads = std::max(1, std::min(threads, rows * cols / 65536 + 1));
+
+	std::vector<int> g(field.value.size());
+	runInParallel(cols, threads, [&](int first, int last)
+	{
+		for (int i = 0; i < rows; ++i)
+		{
+			int* row = &g[std::size_t(i) * cols];
+			const int* above = i > 0 ? row - cols : nullptr;
+			for (int j = first; j < last; ++j)
+			{
+				row[j] = grid[i][j] ? 0 : (above ? std::min(above[j] + 1, inf) : inf);
+			}
+		}
+		for (int i = rows - 2; i >= 0; --i)
+		{
+			int* row = &g[std::size_t(i) * cols];
+			const int* below = row + cols;
+			for (int j = first; j < last; ++j)
+			{
+				row[j] = std::min(row[j], below[j] + 1);
+			}
+		}
+	});
+
+	runInParallel(rows, threads, [&](int first, int last)
+	{
+		std::vector<int> s(cols), t(cols);
+		for (int i = first; i < last; ++i)
+		{
+			const int* gi = &g[std::size_t(i) * cols];
+			int* out = &field.value[std::size_t(i) * cols];
+
+			auto f = [gi](int x, int k) { return std::max(std::abs(x - k), gi[k]); };
+			auto sep = [gi](int k, int u)
+			{
+				return gi[k] <= gi[u] ? std::max(k + gi[u], (k + u) / 2) : std::min(u - gi[k], (k + u) / 2);
+			};
+
+			// s holds the columns whose cones form the envelope, t where each one starts being the minimum
+			int q = 0;
+			s[0] = 0;
+			t[0] = 0;
+			for (int u = 1; u < cols; ++u)
+			{
+				while (q >= 0 && f(t[q], s[q]) > f(t[q], u))
+				{
+					--q;
+				}
+				if (q < 0)
+				{
+					q = 0;
+					s[0] = u;
+				}
+				else
+				{
+					const int w = 1 + sep(s[q], u);
+					if (w < cols)
+					{
+						++q;
+						s[q] = u;
+						t[q] = w;
+					}
+				}
+			}
+			for (int u = cols - 1; u >= 0; --u)
+			{
+				out[u] = std::min(f(u, s[q]), inf);
+				if (u == t[q])
+				{
+					--q;
+				}
+			}
+		}
+	});
+
+	return field;
+}
+
+
+// Bounding box of a set of cells, empty when lo > hi
+struct Box
+{
+	int loI = std::numeric_limits<int>::max();
+	int loJ = std::numeric_limits<int>::max();
+	int hiI = std::numeric_limits<int>::min();
+	int hiJ = std::numeric_limits<int>::min();
+
+	void add(int i, int j)
+	{
+		loI = std::min(loI, i);
+		loJ = std::min(loJ, j);
+		hiI = std::max(hiI, i);
+		hiJ = std::max(hiJ, j);
+	}
+
+	void add(const Box& other)
+	{
+		loI = std::min(loI, other.loI);
+		loJ = std::min(loJ, other.loJ);
+		hiI = std::max(hiI, other.hiI);
+		hiJ = std::max(hiJ, other.hiJ);
+	}
+
+	// true if a single Chebyshev ball of the given radius covers the box
+	bool fits(int radius) const
+	{
+		return loI > hiI || (hiI - loI <= 2 * radius && hiJ - loJ <= 2 * radius);
+	}
+};
+
+
+// Minimum inconvenience after opening one center, computed exactly.
+// The inconvenience can be brought to D if all the cells farther than D from the existing centers
+// fit in one Chebyshev ball of radius D, where the new center goes. The feasibility is monotone in D,
+// so D is binary searched. far[D] is the bounding box of the cells farther than D, built once from the
+// distance field as a suffix union of the boxes of each distance, so every test is O(1).
+int minInconvenience(const DistanceField& field)
+{
+	std::vector<Box> far(field.infinity + 2);
+	for (int i = 0; i < field.rows; ++i)
+	{
+		for (int j = 0; j < field.cols; ++j)
+		{
+			// a cell at distance d is farther than D for every D < d
+			const int d = field.at(i, j);
+			if (d > 0)
+			{
+				far[d - 1].add(i, j);
+			}
+		}
+	}
+	for (int d = field.infinity - 1; d >= 0; --d)
+	{
+		far[d].add(far[d + 1]);
+	}
+
+	int lo = 0;
+	int hi = field.infinity;
+	while (lo < hi)
+	{
+		const int mid = lo + (hi - lo) / 2;
+		if (far[mid].fits(mid))
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+
+// City grid kept up to date across center openings and closings, for what-if queries.
+// Distances are repaired only around the changed cell:
+//   - opening a center lowers the cells closer to it than to any other center, which are found by
+//     a search from the new center that stops at the cells that do not improve
+//   - closing a center raises at most the cells whose distance was the one to it, which are found
+//     by a search from the closed center, then filled from their boundary in increasing distance order
+// A histogram of the distances gives the current inconvenience without scanning the grid.
+class CityGrid
 {
-	Cell maxCell;
-	std::queue<Cell> queue;
-	
-	preProcessData(grid, queue);
+public:
+	explicit CityGrid(const std::vector<std::vector<int>>& grid)
+		: m_field(distanceTransform(grid))
+	{
+		m_center.assign(m_field.value.size(), 0);
+		for (int i = 0; i < m_field.rows; ++i)
+		{
+			for (int j = 0; j < m_field.cols; ++j)
+			{
+				m_center[index(i, j)] = grid[i][j] != 0;
+			}
+		}
+		m_count.assign(m_field.infinity + 1, 0);
+		for (const int d : m_field.value)
+		{
+			++m_count[d];
+		}
+		m_max = m_field.infinity;
+		m_mark.assign(m_field.value.size(), 0);
+		m_buckets.resize(m_field.infinity + 1);
+	}
+
+	/// Current maximum distance of any place from its nearest center
+	int inconvenience()
+	{
+		while (m_max > 0 && m_count[m_max] == 0)
+		{
+			--m_max;
+		}
+		return m_max;
+	}
 
-	if (queue.empty())
+	/// Best inconvenience reachable by opening one more center
+	int minInconvenience() const
 	{
-		const int rows = inGrid.size();
-		const int cols = inGrid[0].size();
-		maxCell = { rows / 2, cols / 2, 0 };
+		return ::minInconvenience(m_field);
 	}
-	else
+
+	const DistanceField& field() const
+	{
+		return m_field;
+	}
+
+	/// Opens a center at (i, j), returns false if there is one already
+	bool addCenter(int i, int j)
 	{
-		processData(grid, queue);
-		queue = std::queue<Cell>();
-		maxCell = findMaxValue(grid);
-		maxCell.value = 0;
+		const int c = index(i, j);
+		if (m_center[c])
+		{
+			return false;
+		}
+		m_center[c] = 1;
+
+		std::vector<int>& frontier = m_buckets[0];
+		frontier.clear();
+		set(c, 0);
+		frontier.push_back(c);
+		for (std::size_t k = 0; k < frontier.size(); ++k)
+		{
+			const int p = frontier[k];
+			forNeighbours(p, [&](int n)
+			{
+				const int d = distance(n, i, j);
+				if (d < m_field.value[n])
+				{
+					set(n, d);
+					frontier.push_back(n);
+				}
+			});
+		}
+		frontier.clear();
+		return true;
 	}
 
-	queue.push(maxCell);
-	processData(grid, queue);
-	maxCell = findMaxValue(grid);
+	/// Closes the center at (i, j), returns false if there is none
+	bool removeCenter(int i, int j)
+	{
+		const int c = index(i, j);
+		if (!m_center[c])
+		{
+			return false;
+		}
+		m_center[c] = 0;
+
+		// cells whose distance came from this center
+		const unsigned stamp = nextStamp();
+		std::vector<int> region = { c };
+		m_mark[c] = stamp;
+		for (std::size_t k = 0; k < region.size(); ++k)
+		{
+			forNeighbours(region[k], [&](int n)
+			{
+				if (m_mark[n] != stamp && !m_center[n] && m_field.value[n] == distance(n, i, j))
+				{
+					m_mark[n] = stamp;
+					region.push_back(n);
+				}
+			});
+		}
 
-	return maxCell.value;
+		// seed each cell of the region from its neighbours outside, then grow in increasing distance
+		const int inf = m_field.infinity;
+		int lowest = inf;
+		for (const int p : region)
+		{
+			int d = inf;
+			forNeighbours(p, [&](int n)
+			{
+				if (m_mark[n] != stamp)
+				{
+					d = std::min(d, m_field.value[n] + 1);
+				}
+			});
+			d = std::min(d, inf);
+			set(p, d);
+			m_buckets[d].push_back(p);
+			lowest = std::min(lowest, d);
+		}
+		for (int d = lowest; d < inf; ++d)
+		{
+			std::vector<int>& bucket = m_buckets[d];
+			for (std::size_t k = 0; k < bucket.size(); ++k)
+			{
+				const int p = bucket[k];
+				if (m_field.value[p] != d)
+				{
+					continue;
+				}
+				forNeighbours(p, [&](int n)
+				{
+					if (m_mark[n] == stamp && m_field.value[n] > d + 1)
+					{
+						set(n, d + 1);
+						m_buckets[d + 1].push_back(n);
+					}
+				});
+			}
+			bucket.clear();
+		}
+		m_buckets[inf].clear();
+		return true;
+	}
+
+private:
+	int index(int i, int j) const
+	{
+		return i * m_field.cols + j;
+	}
+
+	int distance(int p, int i, int j) const
+	{
+		return std::max(std::abs(p / m_field.cols - i), std::abs(p % m_field.cols - j));
+	}
+
+	template <typename F>
+	void forNeighbours(int p, F f) const
+	{
+		const int i = p / m_field.cols;
+		const int j = p % m_field.cols;
+		for (int a = std::max(i - 1, 0); a <= std::min(i + 1, m_field.rows - 1); ++a)
+		{
+			for (int b = std::max(j - 1, 0); b <= std::min(j + 1, m_field.cols - 1); ++b)
+			{
+				if (a != i || b != j)
+				{
+					f(index(a, b));
+				}
+			}
+		}
+	}
+
+	// changes a distance, keeping the histogram in sync
+	void set(int p, int d)
+	{
+		--m_count[m_field.value[p]];
+		++m_count[d];
+		m_field.value[p] = d;
+		m_max = std::max(m_max, d);
+	}
+
+	unsigned nextStamp()
+	{
+		if (++m_stamp == 0)
+		{
+			std::fill(m_mark.begin(), m_mark.end(), 0);
+			m_stamp = 1;
+		}
+		return m_stamp;
+	}
+
+	DistanceField m_field;
+	std::vector<char> m_center;                 // 1 where there is a center
+	std::vector<int> m_count;                   // number of cells at each distance
+	int m_max = 0;                              // upper bound of the highest distance with a cell
+	std::vector<unsigned> m_mark;               // search marks, valid if equal to m_stamp
+	unsigned m_stamp = 0;
+	std::vector<std::vector<int>> m_buckets;    // cells to process, by distance
+};
+
+
+int getMinInconvenience(std::vector<std::vector<int>> grid)
+{
+	return minInconvenience(distanceTransform(grid));
 }
@@ -1,10 +1,13 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
 #include <unordered_map>
 
 // Typedef for readability
-using uint = std::size_t;
 using key_t = int;
 using value_t = std::array<int, 2>;
 using map_t = std::unordered_map<key_t, value_t>;
@@ -13,14 +16,14 @@ using map_t = std::unordered_map<key_t, value_t>;
 int solution(std::vector<int>& A)
 {
     // const is a bit more efficient than a non const
-    const uint N = A.size();
+    const std::size_t N = A.size();
 
     // create a map with key = A[i] and value = (i,j),
     // with i and j being the index of the first and last occurrence respectively
     map_t map;
 
     // iterate over the vector
-    for (uint i = 0; i < N; ++i)
+    for (std::size_t i = 0; i < N; ++i)
     {
         int key = A[i];
         int index = static_cast<int>(i);
@@ -38,7 +41,7 @@ int solution(std::vector<int>& A)
     }
 
     // iterate of the map
-    value_t result = 0;
+    int result = 0;
     for (const auto& item : map)
     {
         // store the maximum element
@@ -48,3 +51,400 @@ int solution(std::vector<int>& A)
     // Return the correct result
     return result;
 }
+
+
+// Flat open addressing table from key to first and last index, with linear probing.
+// Keys and indices live in separate arrays, and an empty slot has first == -1.
+// The table doubles when half full, so its size follows the number of distinct keys.
+template <typename Index>
+class BasicFirstLastTable
+{
+public:
+    // capacity starts at min_capacity (a power of two), or enough for expected keys
+    explicit BasicFirstLastTable(std::size_t expected = 0, std::size_t min_capacity = 1024)
+    {
+        std::size_t capacity = min_capacity;
+        while (capacity < 2 * expected)
+        {
+            capacity *= 2;
+        }
+        allocate(capacity);
+    }
+
+    // records index as an occurrence of key, returning the distance from its first occurrence
+    inline Index insert(int key, Index index)
+    {
+        std::size_t slot = find(key);
+        if (m_first[slot] < 0)
+        {
+            if (2 * (m_size + 1) > m_key.size())
+            {
+                grow();
+                slot = find(key);
+            }
+            m_key[slot] = key;
+            m_first[slot] = index;
+            ++m_size;
+        }
+        m_last[slot] = index;
+        return index - m_first[slot];
+    }
+
+    // merges the occurrences of key found elsewhere, returning the resulting distance
+    inline Index merge(int key, Index first, Index last)
+    {
+        std::size_t slot = find(key);
+        if (m_first[slot] < 0)
+        {
+            if (2 * (m_size + 1) > m_key.size())
+            {
+                grow();
+                slot = find(key);
+            }
+            m_key[slot] = key;
+            m_first[slot] = first;
+            m_last[slot] = last;
+            ++m_size;
+        }
+        else
+        {
+            m_first[slot] = std::min(m_first[slot], first);
+            m_last[slot] = std::max(m_last[slot], last);
+        }
+        return m_last[slot] - m_first[slot];
+    }
+
+    // calls f(key, first, last) for every key in the table
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (std::size_t i = 0; i < m_key.size(); ++i)
+        {
+            if (m_first[i] >= 0)
+            {
+                f(m_key[i], m_first[i], m_last[i]);
+            }
+        }
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    // slot holding key, or the empty slot where it would go
+    inline std::size_t find(int key) const
+    {
+        std::size_t slot = (std::uint64_t(std::uint32_t(key)) * 0x9E3779B97F4A7C15ull) >> m_shift;
+        while (m_first[slot] >= 0 && m_key[slot] != key)
+        {
+            slot = (slot + 1) & m_mask;
+        }
+        return slot;
+    }
+
+    void allocate(std::size_t capacity)
+    {
+        m_shift = 64 - __builtin_ctzll(capacity);
+        m_mask = capacity - 1;
+        m_key.assign(capacity, 0);
+        m_first.assign(capacity, -1);
+        m_last.assign(capacity, 0);
+    }
+
+    void grow()
+    {
+        std::vector<int> key;
+        std::vector<Index> first, last;
+        key.swap(m_key);
+        first.swap(m_first);
+        last.swap(m_last);
+        allocate(2 * key.size());
+        for (std::size_t i = 0; i < key.size(); ++i)
+        {
+            if (first[i] >= 0)
+            {
+                const std::size_t slot = find(key[i]);
+                m_key[slot] = key[i];
+                m_first[slot] = first[i];
+                m_last[slot] = last[i];
+            }
+        }
+    }
+
+    std::vector<int> m_key;
+    std::vector<Index> m_first;
+    std::vector<Index> m_last;
+    std::size_t m_size = 0;
+    std::size_t m_mask = 0;
+    int m_shift = 0;
+};
+
+using FirstLastTable = BasicFirstLastTable<int>;
+
+
+// One lookup-or-insert per element, the distance is tracked while inserting
+int solution_hash(const std::vector<int>& A)
+{
+    FirstLastTable table;
+    int result = 0;
+    for (std::size_t i = 0; i < A.size(); ++i)
+    {
+        result = std::max(result, table.insert(A[i], static_cast<int>(i)));
+    }
+    return result;
+}
+
+
+// Number of 11 bit radix passes needed for the keys of A, relative to their minimum
+std::size_t radix_passes(const std::vector<int>& A, int& lowest)
+{
+    if (A.empty())
+    {
+        lowest = 0;
+        return 0;
+    }
+    const auto range = std::minmax_element(A.begin(), A.end());
+    lowest = *range.first;
+    std::uint32_t span = std::uint32_t(std::int64_t(*range.second) - *range.first);
+    std::size_t passes = 0;
+    while (span)
+    {
+        span >>= 11;
+        ++passes;
+    }
+    return std::max<std::size_t>(passes, 1);
+}
+
+
+// Sorts the (value, index) pairs by value with a stable LSD radix sort: the indices of each value
+// stay in increasing order, so the first and last occurrences are the ends of each run.
+int solution_radix(const std::vector<int>& A)
+{
+    int lowest = 0;
+    const std::size_t passes = radix_passes(A, lowest);
+    const std::size_t N = A.size();
+
+    // key relative to the minimum in the high half, index in the low half
+    std::vector<std::uint64_t> pairs(N), buffer(N);
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        pairs[i] = (std::uint64_t(std::uint32_t(std::int64_t(A[i]) - lowest)) << 32) | i;
+    }
+
+    for (std::size_t pass = 0; pass < passes; ++pass)
+    {
+        const std::size_t shift = 32 + 11 * pass;
+        std::array<std::size_t, 2048> offset{};
+        for (const std::uint64_t p : pairs)
+        {
+            ++offset[(p >> shift) & 2047];
+        }
+        std::size_t sum = 0;
+        for (std::size_t& o : offset)
+        {
+            const std::size_t c = o;
+            o = sum;
+            sum += c;
+        }
+        for (const std::uint64_t p : pairs)
+        {
+            buffer[offset[(p >> shift) & 2047]++] = p;
+        }
+        pairs.swap(buffer);
+    }
+
+    int result = 0;
+    for (std::size_t begin = 0; begin < N;)
+    {
+        std::size_t end = begin + 1;
+        while (end < N && (pairs[end] >> 32) == (pairs[begin] >> 32))
+        {
+            ++end;
+        }
+        result = std::max(result, int(std::uint32_t(pairs[end - 1])) - int(std::uint32_t(pairs[begin])));
+        begin = end;
+    }
+    return result;
+}
+
+
+enum class Strategy
+{
+    Hash,
+    Radix
+};
+
+
+// Picks a strategy from the shape of the input: the radix sort makes a fixed number of passes over
+// the data whatever the keys, while the table does one random access per element, which is cheap
+// only as long as the table stays in cache, i.e. with few distinct keys.
+// The thresholds come from benchmark_strategy runs on uniformly distributed keys.
+Strategy choose_strategy(const std::vector<int>& A)
+{
+    constexpr std::size_t small = 1 << 14;
+    if (A.size() < small)
+    {
+        return Strategy::Hash;
+    }
+
+    // estimate the ratio of distinct keys on a prefix
+    const std::size_t sample = std::min<std::size_t>(A.size(), 4096);
+    std::vector<int> prefix(A.begin(), A.begin() + sample);
+    std::sort(prefix.begin(), prefix.end());
+    const std::size_t distinct = std::unique(prefix.begin(), prefix.end()) - prefix.begin();
+    return distinct * 2 < sample ? Strategy::Hash : Strategy::Radix;
+}
+
+
+// Times both strategies on a prefix of A and returns the faster one,
+// to calibrate choose_strategy on a given machine and data set.
+Strategy benchmark_strategy(const std::vector<int>& A, std::size_t sample = 1 << 20, int repeat = 3)
+{
+    const std::vector<int> prefix(A.begin(), A.begin() + std::min(sample, A.size()));
+    auto time = [&prefix, repeat](int (*f)(const std::vector<int>&))
+    {
+        auto best = std::chrono::steady_clock::duration::max();
+        for (int r = 0; r < repeat; ++r)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            volatile int result = f(prefix);
+            (void)result;
+            best = std::min(best, std::chrono::steady_clock::now() - start);
+        }
+        return best;
+    };
+    return time(solution_radix) < time(solution_hash) ? Strategy::Radix : Strategy::Hash;
+}
+
+
+int solution_fast(const std::vector<int>& A)
+{
+    return choose_strategy(A) == Strategy::Radix ? solution_radix(A) : solution_hash(A);
+}
+
+
+// First and last occurrences split in shards by key hash, for parallel and streaming inputs.
+// Indices are global across appends and 64 bit, so a stream can grow past the size of an array.
+// An append runs in two phases:
+//   1. each thread scans a chunk of the data into private tables, one per shard
+//   2. each shard merges the private tables of its keys (min of firsts, max of lasts) into its own table
+// Keys never cross shards, so the merges run in parallel and each one only touches its part of the keys.
+class ShardedFirstLast
+{
+public:
+    using Index = std::int64_t;
+
+    explicit ShardedFirstLast(std::size_t shards = std::thread::hardware_concurrency())
+        : m_shard(std::max<std::size_t>(1, shards)), m_best(m_shard.size(), 0)
+    {
+    }
+
+    // appends n values, continuing the indices of the previous appends
+    void append(const int* data, std::size_t n, std::size_t threads = std::thread::hardware_concurrency())
+    {
+        const std::size_t S = m_shard.size();
+        threads = std::max<std::size_t>(1, std::min(threads, n / 65536 + 1));
+        const Index base = m_count;
+        auto chunk = [n, threads](std::size_t t) { return n * t / threads; };
+
+        // small appends go straight to the shards
+        if (threads == 1)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const std::size_t s = shard(data[i]);
+                m_best[s] = std::max(m_best[s], m_shard[s].merge(data[i], base + Index(i), base + Index(i)));
+            }
+            m_count += Index(n);
+            return;
+        }
+
+        // private tables start small and grow with the keys they receive, so that their cost follows the
+        // distinct keys of each chunk rather than threads * shards
+        std::vector<std::vector<BasicFirstLastTable<Index>>> local(threads, std::vector<BasicFirstLastTable<Index>>(S, BasicFirstLastTable<Index>(0, 16)));
+        run(threads, [&](std::size_t t)
+        {
+            std::vector<BasicFirstLastTable<Index>>& tables = local[t];
+            for (std::size_t i = chunk(t); i < chunk(t + 1); ++i)
+            {
+                tables[shard(data[i])].insert(data[i], base + Index(i));
+            }
+        });
+
+        run(std::min(threads, S), [&](std::size_t t)
+        {
+            const std::size_t workers = std::min(threads, S);
+            for (std::size_t s = t; s < S; s += workers)
+            {
+                Index best = m_best[s];
+                for (std::size_t u = 0; u < threads; ++u)
+                {
+                    local[u][s].for_each([&](int key, Index first, Index last)
+                    {
+                        best = std::max(best, m_shard[s].merge(key, first, last));
+                    });
+                }
+                m_best[s] = best;
+            }
+        });
+
+        m_count += Index(n);
+    }
+
+    void append(const std::vector<int>& data, std::size_t threads = std::thread::hardware_concurrency())
+    {
+        append(data.data(), data.size(), threads);
+    }
+
+    // maximum distance between the first and last occurrence of a value, over everything appended
+    Index result() const
+    {
+        return *std::max_element(m_best.begin(), m_best.end());
+    }
+
+    Index size() const
+    {
+        return m_count;
+    }
+
+private:
+    std::size_t shard(int key) const
+    {
+        // a different mix than the one of the tables, so that a shard does not crowd their slots
+        const std::uint32_t h = std::uint32_t(key) * 0x85EBCA6Bu;
+        return (std::uint64_t(h ^ (h >> 16)) * m_shard.size()) >> 32;
+    }
+
+    template <typename Job>
+    static void run(std::size_t threads, Job job)
+    {
+        if (threads == 1)
+        {
+            job(std::size_t(0));
+            return;
+        }
+        std::vector<std::thread> pool;
+        for (std::size_t t = 0; t < threads; ++t)
+        {
+            pool.emplace_back(job, t);
+        }
+        for (auto& th : pool)
+        {
+            th.join();
+        }
+    }
+
+    std::vector<BasicFirstLastTable<Index>> m_shard;
+    std::vector<Index> m_best;      // best distance of each shard
+    Index m_count = 0;              // values appended so far
+};
+
+
+int solution_parallel(const std::vector<int>& A, std::size_t threads = std::thread::hardware_concurrency())
+{
+    ShardedFirstLast table(threads);
+    table.append(A, threads);
+    return static_cast<int>(table.result());
+}
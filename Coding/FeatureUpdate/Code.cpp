@@ -1,14 +1,20 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <locale>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <map>
 #include <set>
 #include <utility>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
 // Aliases
-using uint    = std::size_t;
 using word_t  = std::set<std::string>;
-using map_t   = std::map<std::string, uint>;
+using map_t   = std::map<std::string, std::size_t>;
 
 
 // Function for the less operator for comparing <int, string> pairs, where
@@ -23,8 +29,8 @@ struct compare
 
     bool operator()(const std::string& a, const std::string& b) const
     {
-	    const uint ca = m_map->at(a);
-	    const uint cb = m_map->at(b);
+	    const std::size_t ca = m_map->at(a);
+	    const std::size_t cb = m_map->at(b);
         if (ca > cb)
         {
             return true;
@@ -106,20 +112,752 @@ void count(map_t& feature, const std::vector<std::string>& request)
 
 
 
-std::vector<std::string> most_wanted_features(const uint N, const std::vector<std::string>& possibleFeature, const std::vector<std::string>& requestedFeature)
+// ASCII lower case, the features are plain lower case words
+inline char fold(char c)
 {
-    // Initialize map
-    map_t feature = initialize_feature(possibleFeature);
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
 
-    // Populate map
-    count(feature, requestedFeature);
 
-    // Finalize
-	std::vector<std::string> result = possibleFeature;
-	std::sort(result.begin(), result.end(), compare(feature));
-	result.resize(std::min(N, result.size()));
-    
+// Same separators as the stream extraction used by tokenize
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+
+// Calls f on every space-separated word of str, as views into str
+template <typename F>
+void for_each_token(std::string_view str, F f)
+{
+    std::size_t i = 0;
+    while (i < str.size())
+    {
+        while (i < str.size() && is_space(str[i]))
+        {
+            ++i;
+        }
+        const std::size_t begin = i;
+        while (i < str.size() && !is_space(str[i]))
+        {
+            ++i;
+        }
+        if (i > begin)
+        {
+            f(str.substr(begin, i - begin));
+        }
+    }
+}
+
+
+// Hash of the lower case version of a word (FNV-1a), folding while reading
+inline std::uint64_t hash_folded(std::string_view word, std::uint64_t salt)
+{
+    std::uint64_t h = 0xCBF29CE484222325ull ^ salt;
+    for (const char c : word)
+    {
+        h = (h ^ static_cast<unsigned char>(fold(c))) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+
+inline std::uint64_t mix(std::uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+
+
+// Perfect hash from the feature names to their index, built once (hash and displace):
+// the features are split in small buckets, and each bucket gets the first seed that sends all its
+// features to free slots. A lookup hashes the word once, reads its bucket seed, and compares the
+// word with the single feature in the resulting slot.
+class FeatureMatcher
+{
+public:
+    static constexpr int none = -1;
+
+    explicit FeatureMatcher(const std::vector<std::string>& feature)
+        : m_feature(feature)
+    {
+        for (std::uint64_t salt = 0; !build(salt); ++salt)
+        {
+        }
+    }
+
+    /// Index of the feature equal to the lower case word, or none
+    int find(std::string_view word) const
+    {
+        if (m_slot.empty())
+        {
+            return none;
+        }
+        const std::uint64_t h = hash_folded(word, m_salt);
+        const int id = m_slot[slot(h, m_seed[bucket(h)])];
+        return (id != none && equal_folded(word, m_feature[id])) ? id : none;
+    }
+
+    std::size_t size() const
+    {
+        return m_feature.size();
+    }
+
+    const std::string& name(int id) const
+    {
+        return m_feature[id];
+    }
+
+    const std::vector<std::string>& features() const
+    {
+        return m_feature;
+    }
+
+private:
+    std::size_t bucket(std::uint64_t h) const
+    {
+        return (h >> 32) % m_seed.size();
+    }
+
+    std::size_t slot(std::uint64_t h, std::uint32_t seed) const
+    {
+        return mix(h + seed * 0x9E3779B97F4A7C15ull) & (m_slot.size() - 1);
+    }
+
+    static bool equal_folded(std::string_view word, const std::string& feature)
+    {
+        if (word.size() != feature.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < word.size(); ++i)
+        {
+            if (fold(word[i]) != feature[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // returns false if two different features collide on the full hash, to retry with another salt
+    bool build(std::uint64_t salt)
+    {
+        const std::size_t F = m_feature.size();
+        m_salt = salt;
+        if (F == 0)
+        {
+            m_seed.clear();
+            m_slot.clear();
+            return true;
+        }
+
+        std::size_t capacity = 1;
+        while (capacity < F + F / 4 + 1)
+        {
+            capacity *= 2;
+        }
+        m_slot.assign(capacity, none);
+        m_seed.assign(F / 4 + 1, 0);
+
+        std::vector<std::uint64_t> h(F);
+        std::vector<std::vector<int>> members(m_seed.size());
+        for (std::size_t i = 0; i < F; ++i)
+        {
+            h[i] = hash_folded(m_feature[i], salt);
+            // features with upper case letters can never match a folded word,
+            // and repeated features keep their first occurrence
+            std::vector<int>& keys = members[bucket(h[i])];
+            const bool repeated = std::any_of(keys.begin(), keys.end(), [&](int k) { return h[k] == h[i] && m_feature[k] == m_feature[i]; });
+            if (equal_folded(m_feature[i], m_feature[i]) && !repeated)
+            {
+                keys.push_back(static_cast<int>(i));
+            }
+        }
+
+        // largest buckets first, while there is the most room
+        std::vector<std::size_t> order(m_seed.size());
+        for (std::size_t b = 0; b < order.size(); ++b)
+        {
+            order[b] = b;
+        }
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return members[a].size() > members[b].size(); });
+
+        std::vector<std::size_t> taken;
+        for (const std::size_t b : order)
+        {
+            const std::vector<int>& keys = members[b];
+            for (std::uint32_t seed = 0;; ++seed)
+            {
+                if (seed == (1u << 20))
+                {
+                    return false;
+                }
+                taken.clear();
+                bool free = true;
+                for (int k : keys)
+                {
+                    const std::size_t s = slot(h[k], seed);
+                    if (m_slot[s] != none || std::find(taken.begin(), taken.end(), s) != taken.end())
+                    {
+                        free = false;
+                        break;
+                    }
+                    taken.push_back(s);
+                }
+                if (free)
+                {
+                    m_seed[b] = seed;
+                    for (std::size_t k = 0; k < keys.size(); ++k)
+                    {
+                        m_slot[taken[k]] = keys[k];
+                    }
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::string> m_feature;
+    std::vector<std::uint32_t> m_seed;  // displacement of each bucket
+    std::vector<int> m_slot;            // feature index of each slot, or none
+    std::uint64_t m_salt = 0;
+};
+
+
+// Visits the features mentioned by a request, without allocating once constructed.
+// A feature mentioned several times in a request is visited once: each feature remembers the last
+// request that visited it, as a generation number.
+class RequestFeatures
+{
+public:
+    explicit RequestFeatures(const FeatureMatcher& matcher)
+        : m_matcher(&matcher), m_stamp(matcher.size(), 0)
+    {
+    }
+
+    template <typename F>
+    void for_each(std::string_view request, F f)
+    {
+        if (++m_generation == 0)
+        {
+            std::fill(m_stamp.begin(), m_stamp.end(), 0);
+            m_generation = 1;
+        }
+        for_each_token(request, [&](std::string_view word)
+        {
+            const int id = m_matcher->find(word);
+            if (id != FeatureMatcher::none && m_stamp[id] != m_generation)
+            {
+                m_stamp[id] = m_generation;
+                f(id);
+            }
+        });
+    }
+
+private:
+    const FeatureMatcher* m_matcher;
+    std::vector<std::uint32_t> m_stamp;
+    std::uint32_t m_generation = 0;
+};
+
+
+// Counts the requests mentioning each feature
+class FeatureCounter
+{
+public:
+    explicit FeatureCounter(const FeatureMatcher& matcher)
+        : m_features(matcher), m_count(matcher.size(), 0)
+    {
+    }
+
+    void count(std::string_view request)
+    {
+        m_features.for_each(request, [this](int id) { ++m_count[id]; });
+    }
+
+    /// Number of requests mentioning each feature, by feature index
+    const std::vector<std::size_t>& counts() const
+    {
+        return m_count;
+    }
+
+private:
+    RequestFeatures m_features;
+    std::vector<std::size_t> m_count;
+};
+
+
+// Number of requests mentioning each feature, by feature index.
+// Each thread counts a chunk of the requests in its own counters, which are then summed.
+std::vector<std::size_t> count_requests(const FeatureMatcher& matcher, const std::vector<std::string>& request, std::size_t threads = std::thread::hardware_concurrency())
+{
+    const std::size_t R = request.size();
+    threads = std::max<std::size_t>(1, std::min(threads, R / 4096 + 1));
+
+    std::vector<FeatureCounter> counter(threads, FeatureCounter(matcher));
+    auto work = [&](std::size_t t)
+    {
+        for (std::size_t i = R * t / threads; i < R * (t + 1) / threads; ++i)
+        {
+            counter[t].count(request[i]);
+        }
+    };
+    if (threads == 1)
+    {
+        work(0);
+        return counter[0].counts();
+    }
+
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back(work, t);
+    }
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+
+    std::vector<std::size_t> total = counter[0].counts();
+    for (std::size_t t = 1; t < threads; ++t)
+    {
+        const std::vector<std::size_t>& c = counter[t].counts();
+        for (std::size_t f = 0; f < total.size(); ++f)
+        {
+            total[f] += c[f];
+        }
+    }
+    return total;
+}
+
+
+// The N features with the highest count, ties broken alphabetically.
+// Only the N best are sorted, after being moved in front by nth_element.
+std::vector<std::string> top_features(const std::size_t N, const std::vector<std::string>& feature, const std::vector<std::size_t>& count)
+{
+    std::vector<std::size_t> order(feature.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    auto before = [&](std::size_t a, std::size_t b)
+    {
+        return (count[a] != count[b]) ? (count[a] > count[b]) : (feature[a] < feature[b]);
+    };
+
+    const std::size_t K = std::min(N, order.size());
+    if (K < order.size())
+    {
+        std::nth_element(order.begin(), order.begin() + K, order.end(), before);
+    }
+    std::sort(order.begin(), order.begin() + K, before);
+
+    std::vector<std::string> result;
+    result.reserve(K);
+    for (std::size_t i = 0; i < K; ++i)
+    {
+        result.push_back(feature[order[i]]);
+    }
     return result;
 }
 
 
+// Count of every feature from the counts by matcher index: repeated features share the count of
+// their first occurrence, features with upper case letters never match
+std::vector<std::size_t> feature_counts(const FeatureMatcher& matcher, const std::vector<std::size_t>& total)
+{
+    const std::vector<std::string>& feature = matcher.features();
+    std::vector<std::size_t> count(feature.size(), 0);
+    for (std::size_t i = 0; i < count.size(); ++i)
+    {
+        const int id = matcher.find(feature[i]);
+        if (id != FeatureMatcher::none && matcher.name(id) == feature[i])
+        {
+            count[i] = total[id];
+        }
+    }
+    return count;
+}
+
+
+std::vector<std::string> most_wanted_features(const std::size_t N, const std::vector<std::string>& possibleFeature, const std::vector<std::string>& requestedFeature,
+                                              std::size_t threads = std::thread::hardware_concurrency())
+{
+    // Count the requests mentioning each feature
+    const FeatureMatcher matcher(possibleFeature);
+    const std::vector<std::size_t> total = count_requests(matcher, requestedFeature, threads);
+
+    // Finalize
+    return top_features(N, possibleFeature, feature_counts(matcher, total));
+}
+
+
+// Sliding time window split in buckets of fixed width, reused as a ring.
+// Times are in any unit (e.g. seconds) and are expected to be non-negative.
+class WindowClock
+{
+public:
+    WindowClock(std::int64_t width, std::size_t buckets)
+        : m_width(std::max<std::int64_t>(1, width)), m_buckets(std::max<std::size_t>(1, buckets))
+    {
+    }
+
+    std::size_t buckets() const
+    {
+        return m_buckets;
+    }
+
+    /// Moves the window forward to time, calling expire on the ring slot of every bucket that falls
+    /// out of it. Returns the slot of time, or -1 if time is already out of the window.
+    template <typename Expire>
+    std::ptrdiff_t advance(std::int64_t time, Expire expire)
+    {
+        const std::int64_t b = time / m_width;
+        const std::int64_t B = static_cast<std::int64_t>(m_buckets);
+        if (!m_started)
+        {
+            m_head = b;
+            m_started = true;
+        }
+        if (b > m_head)
+        {
+            const std::int64_t steps = std::min(b - m_head, B);
+            for (std::int64_t k = 1; k <= steps; ++k)
+            {
+                expire(static_cast<std::size_t>((m_head + k) % B));
+            }
+            m_head = b;
+        }
+        return (b > m_head - B) ? static_cast<std::ptrdiff_t>(b % B) : -1;
+    }
+
+private:
+    std::int64_t m_width;
+    std::size_t m_buckets;
+    std::int64_t m_head = 0;
+    bool m_started = false;
+};
+
+
+// Exact counts of the requests mentioning each feature over the last buckets * width time units.
+// Every bucket keeps the features it counted, to take them back out of the totals when it expires,
+// so a query only depends on the number of features and not on the number of requests.
+class FeatureWindow
+{
+public:
+    FeatureWindow(const std::vector<std::string>& possibleFeature, std::int64_t width, std::size_t buckets)
+        : m_matcher(possibleFeature), m_features(m_matcher), m_clock(width, buckets),
+          m_bucket(m_clock.buckets()), m_count(m_matcher.size(), 0)
+    {
+    }
+
+    FeatureWindow(const FeatureWindow&) = delete;
+    FeatureWindow& operator=(const FeatureWindow&) = delete;
+
+    /// Adds a request made at time; requests older than the window are ignored
+    void add(std::int64_t time, std::string_view request)
+    {
+        const std::ptrdiff_t slot = advance(time);
+        if (slot < 0)
+        {
+            return;
+        }
+        std::vector<int>& bucket = m_bucket[slot];
+        m_features.for_each(request, [&](int id)
+        {
+            ++m_count[id];
+            bucket.push_back(id);
+        });
+    }
+
+    /// The N most requested features in the window ending at now, ties broken alphabetically
+    std::vector<std::string> most_wanted(const std::size_t N, std::int64_t now)
+    {
+        advance(now);
+        return top_features(N, m_matcher.features(), feature_counts(m_matcher, m_count));
+    }
+
+private:
+    std::ptrdiff_t advance(std::int64_t time)
+    {
+        return m_clock.advance(time, [this](std::size_t slot)
+        {
+            for (int id : m_bucket[slot])
+            {
+                --m_count[id];
+            }
+            m_bucket[slot].clear();
+        });
+    }
+
+    FeatureMatcher m_matcher;
+    RequestFeatures m_features;
+    WindowClock m_clock;
+    std::vector<std::vector<int>> m_bucket;  // features counted in each bucket
+    std::vector<std::size_t> m_count;        // requests in the window, by matcher index
+};
+
+
+// Approximate counts over the same sliding window, for an open vocabulary rather than a fixed set of features.
+// Every bucket has its own Count-Min sketch, and their sum estimates the requests mentioning a word
+// (never below the true count). A Space-Saving style set of candidates keeps the words with the
+// highest estimates: a new word replaces the weakest candidate once its estimate is larger.
+// Only the words passing accept (given in lower case) are counted; without it every raw word is ranked,
+// so stop words such as "the" would crowd out the features.
+// Memory is fixed by the sketch size and the number of candidates.
+class ApproxFeatureWindow
+{
+public:
+    using Accept = std::function<bool(std::string_view)>;
+
+    ApproxFeatureWindow(std::int64_t width, std::size_t buckets, std::size_t candidates, Accept accept = Accept(),
+                        std::size_t depth = 4, std::size_t columns = 4096)
+        : m_clock(width, buckets), m_depth(std::max<std::size_t>(1, depth)), m_columns(std::max<std::size_t>(1, columns)),
+          m_sketch(m_clock.buckets() * m_depth * m_columns, 0), m_total(m_depth * m_columns, 0),
+          m_capacity(std::max<std::size_t>(1, candidates)), m_accept(std::move(accept))
+    {
+        m_candidate.reserve(m_capacity);
+    }
+
+    /// Adds a request made at time; requests older than the window are ignored
+    void add(std::int64_t time, std::string_view request)
+    {
+        const std::ptrdiff_t slot = advance(time);
+        if (slot < 0)
+        {
+            return;
+        }
+        std::uint32_t* sketch = &m_sketch[slot * m_depth * m_columns];
+
+        m_seen.clear();
+        for_each_token(request, [&](std::string_view token)
+        {
+            m_word.assign(token.begin(), token.end());
+            for (char& c : m_word)
+            {
+                c = fold(c);
+            }
+            if (m_accept && !m_accept(m_word))
+            {
+                return;
+            }
+            const std::uint64_t h = hash_folded(m_word, 0);
+            if (!m_seen.insert(h))
+            {
+                return;
+            }
+
+            for (std::size_t d = 0; d < m_depth; ++d)
+            {
+                const std::size_t c = cell(h, d);
+                ++sketch[c];
+                ++m_total[c];
+            }
+            offer(m_word, h, estimate(h));
+        });
+    }
+
+    /// The N words with the highest estimated count in the window ending at now, ties broken alphabetically
+    std::vector<std::string> most_wanted(const std::size_t N, std::int64_t now)
+    {
+        advance(now);
+        std::vector<const Candidate*> best;
+        best.reserve(m_candidate.size());
+        for (const Candidate& c : m_candidate)
+        {
+            if (c.estimate > 0)
+            {
+                best.push_back(&c);
+            }
+        }
+        auto before = [](const Candidate* a, const Candidate* b)
+        {
+            return (a->estimate != b->estimate) ? (a->estimate > b->estimate) : (a->word < b->word);
+        };
+        const std::size_t K = std::min(N, best.size());
+        std::partial_sort(best.begin(), best.begin() + K, best.end(), before);
+
+        std::vector<std::string> result;
+        result.reserve(K);
+        for (std::size_t i = 0; i < K; ++i)
+        {
+            result.push_back(best[i]->word);
+        }
+        return result;
+    }
+
+private:
+    // Set of word hashes of the current request, cleared in constant time by a new generation
+    class SeenSet
+    {
+    public:
+        void clear()
+        {
+            m_size = 0;
+            if (++m_generation == 0)
+            {
+                std::fill(m_stamp.begin(), m_stamp.end(), 0);
+                m_generation = 1;
+            }
+        }
+
+        // true if h was not in the set
+        bool insert(std::uint64_t h)
+        {
+            if (2 * (m_size + 1) > m_key.size())
+            {
+                grow();
+            }
+            std::size_t slot = mix(h) & (m_key.size() - 1);
+            while (m_stamp[slot] == m_generation)
+            {
+                if (m_key[slot] == h)
+                {
+                    return false;
+                }
+                slot = (slot + 1) & (m_key.size() - 1);
+            }
+            m_stamp[slot] = m_generation;
+            m_key[slot] = h;
+            ++m_size;
+            return true;
+        }
+
+    private:
+        void grow()
+        {
+            std::vector<std::uint64_t> key(std::max<std::size_t>(64, 2 * m_key.size()));
+            std::vector<std::uint32_t> stamp(key.size(), 0);
+            for (std::size_t i = 0; i < m_key.size(); ++i)
+            {
+                if (m_stamp[i] == m_generation)
+                {
+                    std::size_t slot = mix(m_key[i]) & (key.size() - 1);
+                    while (stamp[slot] == m_generation)
+                    {
+                        slot = (slot + 1) & (key.size() - 1);
+                    }
+                    stamp[slot] = m_generation;
+                    key[slot] = m_key[i];
+                }
+            }
+            m_key.swap(key);
+            m_stamp.swap(stamp);
+        }
+
+        std::vector<std::uint64_t> m_key;
+        std::vector<std::uint32_t> m_stamp;
+        std::uint32_t m_generation = 1;
+        std::size_t m_size = 0;
+    };
+
+    struct Candidate
+    {
+        std::string word;  // lower case
+        std::uint64_t hash;
+        std::size_t estimate;
+    };
+
+    std::size_t cell(std::uint64_t h, std::size_t d) const
+    {
+        return d * m_columns + mix(h + d * 0x9E3779B97F4A7C15ull) % m_columns;
+    }
+
+    std::size_t estimate(std::uint64_t h) const
+    {
+        std::size_t e = m_total[cell(h, 0)];
+        for (std::size_t d = 1; d < m_depth; ++d)
+        {
+            e = std::min<std::size_t>(e, m_total[cell(h, d)]);
+        }
+        return e;
+    }
+
+    // word is in lower case
+    void offer(std::string_view word, std::uint64_t h, std::size_t e)
+    {
+        const auto it = m_index.find(h);
+        if (it != m_index.end())
+        {
+            m_candidate[it->second].estimate = e;
+            return;
+        }
+        if (m_candidate.size() < m_capacity)
+        {
+            m_index.emplace(h, m_candidate.size());
+            m_candidate.push_back({ std::string(word), h, e });
+            return;
+        }
+        if (e <= m_floor)
+        {
+            return;
+        }
+
+        std::size_t weakest = 0;
+        for (std::size_t i = 1; i < m_candidate.size(); ++i)
+        {
+            if (m_candidate[i].estimate < m_candidate[weakest].estimate)
+            {
+                weakest = i;
+            }
+        }
+        if (e > m_candidate[weakest].estimate)
+        {
+            m_index.erase(m_candidate[weakest].hash);
+            m_index.emplace(h, weakest);
+            m_candidate[weakest] = { std::string(word), h, e };
+        }
+        update_floor();
+    }
+
+    void update_floor()
+    {
+        m_floor = m_candidate.empty() ? 0 : m_candidate[0].estimate;
+        for (const Candidate& c : m_candidate)
+        {
+            m_floor = std::min(m_floor, c.estimate);
+        }
+    }
+
+    std::ptrdiff_t advance(std::int64_t time)
+    {
+        bool expired = false;
+        const std::ptrdiff_t slot = m_clock.advance(time, [&](std::size_t s)
+        {
+            std::uint32_t* sketch = &m_sketch[s * m_depth * m_columns];
+            for (std::size_t c = 0; c < m_depth * m_columns; ++c)
+            {
+                m_total[c] -= sketch[c];
+                sketch[c] = 0;
+            }
+            expired = true;
+        });
+        // estimates only go down when a bucket expires
+        if (expired)
+        {
+            for (Candidate& c : m_candidate)
+            {
+                c.estimate = estimate(c.hash);
+            }
+            update_floor();
+        }
+        return slot;
+    }
+
+    WindowClock m_clock;
+    std::size_t m_depth;
+    std::size_t m_columns;
+    std::vector<std::uint32_t> m_sketch;  // depth x columns counters per bucket
+    std::vector<std::uint32_t> m_total;   // sum of the bucket sketches
+    std::size_t m_capacity;
+    std::vector<Candidate> m_candidate;
+    std::unordered_map<std::uint64_t, std::size_t> m_index;  // candidate of each word hash
+    std::size_t m_floor = 0;                                  // lowest candidate estimate
+    Accept m_accept;                                          // words to count, all if empty
+    SeenSet m_seen;                                           // words of the current request
+    std::string m_word;                                       // current word, in lower case
+};
@@ -1,3 +1,6 @@
+#include <cstddef>
+
+
 struct Node
 {
     Node* next = nullptr;
@@ -11,31 +14,217 @@ bool is_looping(Node* root)
     Node* fast = root;
 
     // While the end is not reached
-    while (slow)
+    while (fast && fast->next)
     {
         // Advance the slow of one step
         slow = slow->next;
 
-        // Advance the fast of one step
-        fast = fast->next;
+        // Advance the fast of two steps
+        fast = fast->next->next;
+
+        // If the two iterators are the same, there is a loop
+        if (slow == fast)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Loop found in a list: the first node on the loop, and the number of nodes on it
+struct LoopInfo
+{
+    bool   looping = false;
+    Node*  entry   = nullptr;
+    size_t length  = 0;
+};
+
+
+// Given the length of the loop, finds its first node: a pointer sent length steps ahead of another
+// one, both starting from root, meets it exactly at the entry
+Node* loop_entry(Node* root, size_t length)
+{
+    Node* tortoise = root;
+    Node* hare     = root;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hare = hare->next;
+    }
+    while (tortoise != hare)
+    {
+        tortoise = tortoise->next;
+        hare     = hare->next;
+    }
+    return tortoise;
+}
+
+
+// Brent's algorithm: the tortoise waits at powers of two while the hare walks alone, so each step
+// follows a single pointer, and the distance walked since the last jump is the loop length
+LoopInfo find_loop(Node* root)
+{
+    LoopInfo info;
+    if (!root)
+    {
+        return info;
+    }
+
+    Node*  tortoise = root;
+    Node*  hare     = root->next;
+    size_t power    = 1;
+    size_t length   = 1;
+    while (hare != tortoise)
+    {
+        // End has been reached
+        if (!hare)
+        {
+            return info;
+        }
 
-        // If it is not null
-        if (fast)
+        // Teleport the tortoise to the hare, and double the wait
+        if (power == length)
         {
-            // Advance another step
-            fast = fast->next;
+            tortoise = hare;
+            power   *= 2;
+            length   = 0;
         }
-        else
+        hare = hare->next;
+        ++length;
+    }
+
+    info.looping = true;
+    info.length  = length;
+    info.entry   = loop_entry(root, length);
+    return info;
+}
+
+
+// Checks many lists at once. Following a pointer of a single list always waits for the previous load,
+// so a few lists are walked in turns, one step each, prefetching the next nodes to visit: the cache
+// misses of the different lists overlap instead of adding up.
+// The result of the list roots[i] is written in out[i].
+void find_loops(Node* const* roots, size_t n, LoopInfo* out, size_t lanes = 16)
+{
+    // Brent search, then hare sent length steps ahead, then both walked to the entry
+    enum Phase { Search, Ahead, Entry };
+    struct Lane
+    {
+        size_t index;
+        Phase  phase;
+        Node*  tortoise;
+        Node*  hare;
+        size_t power;
+        size_t length;
+        size_t steps;
+    };
+
+    Lane lane[64];
+    lanes = (lanes == 0) ? 1 : (lanes > 64) ? 64 : lanes;
+
+    size_t next = 0;
+    size_t live = 0;
+
+    // Starts the next list in lane l, completing at once the empty ones
+    auto start = [&](Lane& l)
+    {
+        while (next < n && !roots[next])
+        {
+            out[next++] = LoopInfo();
+        }
+        if (next == n)
         {
-            // End has been reached
             return false;
         }
+        Node* root = roots[next];
+        l          = Lane{ next++, Search, root, root->next, 1, 1, 0 };
+        if (l.hare)
+        {
+            __builtin_prefetch(l.hare);
+        }
+        return true;
+    };
 
-        // If the two iterators are the same, there is a loop
-        if (slow == fast)
+    while (live < lanes && start(lane[live]))
+    {
+        ++live;
+    }
+
+    while (live > 0)
+    {
+        for (size_t i = 0; i < live;)
         {
-            return true;
+            Lane& l    = lane[i];
+            bool  done = false;
+            switch (l.phase)
+            {
+            case Search:
+                if (!l.hare)
+                {
+                    out[l.index] = LoopInfo();
+                    done         = true;
+                }
+                else if (l.hare == l.tortoise)
+                {
+                    l.phase    = Ahead;
+                    l.tortoise = roots[l.index];
+                    l.hare     = l.tortoise;
+                    l.steps    = l.length;
+                    __builtin_prefetch(l.hare);
+                }
+                else
+                {
+                    if (l.power == l.length)
+                    {
+                        l.tortoise = l.hare;
+                        l.power   *= 2;
+                        l.length   = 0;
+                    }
+                    l.hare = l.hare->next;
+                    ++l.length;
+                    if (l.hare)
+                    {
+                        __builtin_prefetch(l.hare);
+                    }
+                }
+                break;
+
+            case Ahead:
+                if (l.steps == 0)
+                {
+                    l.phase = Entry;
+                }
+                else
+                {
+                    l.hare = l.hare->next;
+                    --l.steps;
+                    __builtin_prefetch(l.hare);
+                }
+                break;
+
+            case Entry:
+                if (l.tortoise == l.hare)
+                {
+                    out[l.index] = LoopInfo{ true, l.tortoise, l.length };
+                    done         = true;
+                }
+                else
+                {
+                    l.tortoise = l.tortoise->next;
+                    l.hare     = l.hare->next;
+                    __builtin_prefetch(l.tortoise);
+                    __builtin_prefetch(l.hare);
+                }
+                break;
+            }
+
+            // Refill the lane, or drop it by moving the last one in its place
+            if (done && !start(l))
+            {
+                lane[i] = lane[--live];
+                continue;
+            }
+            ++i;
         }
     }
-    return false;
 }